@@ -379,6 +379,125 @@ namespace ipr::util {
    };
 
    enum class hash_code : std::size_t { };
+
+   // Hash code of the address of a node, for tables keyed by node identity.  The address is
+   // multiplied by an odd constant, then its high bits are folded onto the low bits, which are
+   // those selecting slots; the low bits of an aligned address carry no information.
+   inline hash_code hash_address(const void* p)
+   {
+      const auto x = static_cast<std::uint64_t>(reinterpret_cast<std::uintptr_t>(p)) * 0x9E3779B97F4A7C15;
+      return hash_code{ static_cast<std::size_t>(x ^ (x >> 32)) };
+   }
+
+   // Hash code combining the hash code `h` with the hash code `x` of one more component.
+   constexpr hash_code hash_combine(hash_code h, hash_code x)
+   {
+      const auto y = (static_cast<std::uint64_t>(h) ^ static_cast<std::uint64_t>(x)) * 0x9E3779B97F4A7C15;
+      return hash_code{ static_cast<std::size_t>(y ^ (y >> 32)) };
+   }
+
+   // Storage of objects of type T, allocated by chunks of many objects at a time instead of one
+   // by one.  Objects are never moved, and are destroyed along with the storage.
+   template<typename T>
+   struct slab : private std::allocator<T> {
+      slab() = default;
+      slab(const slab&) = delete;
+      slab& operator=(const slab&) = delete;
+      ~slab()
+      {
+         for (std::size_t i = 0; i < chunks.size(); ++i)
+         {
+            std::destroy_n(chunks[i], i + 1 < chunks.size() ? chunk_size() : used);
+            this->deallocate(chunks[i], chunk_size());
+         }
+      }
+
+      template<typename... Args>
+      T* make(Args&&... args)
+      {
+         if (used == chunk_size())
+         {
+            chunks.reserve(chunks.size() + 1);
+            chunks.push_back(this->allocate(chunk_size()));
+            used = 0;
+         }
+         auto p = std::construct_at(chunks.back() + used, std::forward<Args>(args)...);
+         ++used;
+         return p;
+      }
+
+   private:
+      // Number of objects per chunk: enough to fill a few pages.
+      static constexpr std::size_t chunk_size() { return std::max<std::size_t>(16, 16384 / sizeof(T)); }
+
+      std::vector<T*> chunks;
+      std::size_t used = chunk_size();         // number of objects in the last chunk
+   };
+
+   // Hash table of unique nodes of type T, for hash-consing: a node is made from a key only if no
+   // node equal to that key is in the table already.  The slots hold the addresses of the nodes
+   // along with their hash codes, and are probed linearly; the nodes are stored in a slab.
+   template<typename T>
+   struct unique_table {
+      // Return the node with hash code `h` equal to `key` according to `eq`, making it from `key`
+      // if there is none.
+      template<typename Key, typename Eq>
+      T* insert(const Key& key, hash_code h, Eq eq)
+      {
+         // Keep the load factor at most 1/2, for short probe sequences.
+         if (2 * (count + 1) > slots.size())
+            grow();
+         const auto mask = slots.size() - 1;
+         auto pos = static_cast<std::size_t>(h) & mask;
+         for (; slots[pos].node != nullptr; pos = (pos + 1) & mask)
+         {
+            if (slots[pos].hash == h and eq(*slots[pos].node, key))
+               return slots[pos].node;
+         }
+         const auto node = nodes.make(key);
+         slots[pos] = { h, node };
+         ++count;
+         return node;
+      }
+
+      // Hint the processor to bring into cache the first slot probed for hash code `h`, ahead of
+      // a call to insert with that hash code.
+      void prefetch(hash_code h) const
+      {
+         if (slots.empty())
+            return;
+#if defined(__GNUC__)
+         __builtin_prefetch(&slots[static_cast<std::size_t>(h) & (slots.size() - 1)]);
+#endif
+      }
+
+      std::size_t size() const { return count; }
+
+   private:
+      struct slot {
+         hash_code hash;
+         T* node;
+      };
+
+      std::vector<slot> slots;
+      std::size_t count = 0;
+      slab<T> nodes;
+
+      void grow()
+      {
+         auto previous = std::exchange(slots, std::vector<slot>(slots.empty() ? 64 : 2 * slots.size()));
+         const auto mask = slots.size() - 1;
+         for (auto& s : previous)
+         {
+            if (s.node == nullptr)
+               continue;
+            auto pos = static_cast<std::size_t>(s.hash) & mask;
+            while (slots[pos].node != nullptr)
+               pos = (pos + 1) & mask;
+            slots[pos] = s;
+         }
+      }
+   };
 }
 
 namespace ipr::impl {
@@ -1151,23 +1270,193 @@ namespace ipr::impl {
 namespace ipr::impl {
                              // -- impl::String --
    export struct String : immotile_node<ipr::String> {
+      // Identification number of a string not interned by a string pool, which no interned
+      // string has.
+      static constexpr std::uint32_t unnumbered = ~std::uint32_t{ };
+
       constexpr String(const char8_t* s) : txt{ s } { }
       constexpr String(util::word_view w) : txt{ w } { }
+      constexpr String(util::word_view w, std::uint32_t n) : txt{ w }, number{ n } { }
       constexpr util::word_view characters() const final { return txt; }
+      // Identification number of a string interned by a string pool; see util::intern_id.
+      constexpr std::uint32_t intern_id() const { return number; }
    private:
       const util::word_view txt;
+      const std::uint32_t number = unnumbered;
    };
 }
 
 namespace ipr::util {
+   // Open-addressing hash table of strings, in the style of SwissTable.  Each slot holds a string
+   // along with its hash code, and has a control byte holding either a marker of vacancy or 7 bits
+   // of that hash code.  Slots are probed by groups: the control bytes of a whole group are matched
+   // at once, and only the strings of the slots with matching control bytes are compared.
+   // Strings are never removed; hence there is no tombstone.
+   struct string_table {
+      // Return the string of characters `w` with hash code `h` if it is in the table, otherwise null.
+      const impl::String* find(word_view w, hash_code h) const;
+
+      // Enter into the table a string, with hash code `h`, not already there.
+      void insert(const impl::String&, hash_code h);
+
+      // Hint the processor to fetch the slots first probed for hash code `h`, ahead of a lookup.
+      void prefetch(hash_code h) const;
+
+      std::size_t size() const { return count; }
+
+   private:
+      struct slot {
+         hash_code hash;
+         const impl::String* string;
+      };
+
+      // The control bytes of the first group are repeated past the last slot, so that a group
+      // may be loaded from any slot.
+      std::vector<std::uint8_t> controls;
+      std::vector<slot> slots;
+      std::size_t count = 0;
+
+      void enter(const slot&);
+      void grow();
+   };
+
+   // Read-only image of the strings of a string pool, as written by string_pool::write_image.
+   // The image is relocatable: it holds the characters and hash codes of its strings, along with
+   // a lookup table of positions, and no address.  It is meant to be memory-mapped from a file,
+   // e.g. by ipr::input::SourceFile, and shared by the many processes seeding their string pools
+   // with the same words.  The image does not own its bytes, which shall outlive it.
+   // Note: The hash codes recorded in an image are those of the build that wrote it; an image
+   //       written by a build hashing differently is rejected.
+   // Note: An image shall be written by string_pool::write_image of the same build.  Its hash
+   //       codes and lookup table are trusted, not recomputed, lest loading cost as much as
+   //       interning its strings anew: a string of an image altered by other means may not be
+   //       found, and a pool layered over it would then intern that string a second time.
+   export struct string_image {
+      // Position of an absent string.
+      static constexpr std::uint32_t absent = ~std::uint32_t{};
+
+      // Raise std::runtime_error if the bytes do not hold an image of the expected format, build
+      // and bounds; see the note above on what is not checked.
+      explicit string_image(std::span<const char8_t>);
+
+      std::uint32_t size() const { return count; }
+
+      // Position of the string of characters `w` with hash code `h` if it is in the image,
+      // otherwise `absent`.
+      std::uint32_t find(word_view w, hash_code h) const;
+
+      // Characters of the string at a given position.
+      word_view characters(std::uint32_t) const;
+
+      // Hint the processor to fetch the slot first probed for hash code `h`, ahead of a lookup.
+      void prefetch(hash_code h) const;
+
+   private:
+      std::span<const char8_t> bytes;
+      std::uint32_t count = 0;
+      std::size_t mask = 0;           // capacity of the lookup table, minus 1
+      const char8_t* entries = nullptr;
+      const char8_t* table = nullptr;
+      const char8_t* chars = nullptr;
+   };
+
+   // Dense identification number of an interned string.  The empty string is numbered 0, the
+   // statically known words are numbered next, in the order of their table, then the words
+   // interned by a string pool are numbered in order of interning.  The numbers of the strings of
+   // a pool are thus stable, and dense enough to index flat tables or bitsets, in lieu of maps
+   // keyed by addresses.  The number of an identifier is that of its string.
+   // Any other string, not interned by a pool, is numbered impl::String::unnumbered, so that it
+   // is never taken for an interned string; so are strings of other implementations of ipr::String.
+   export std::uint32_t intern_id(const ipr::String&);
+
    // String pool.  Used to intern words used for external designation of entities.
-   export struct string_pool : private std::map<util::hash_code, std::forward_list<impl::String>> {
+   export struct string_pool {
+      // Layer this pool over the strings of an image: the strings of the image are interned
+      // without copying their characters, and keep the identification numbers they had in the
+      // pool that wrote the image.  To be called before any string is interned by this pool.
+      // Note: The image shall outlive this pool.
+      void layer_over(const string_image&);
+
+      // Write the image of the strings of this pool, including those of the image it is layered
+      // over, if any.  A pool layered over the image so written interns strings with the same
+      // identification numbers as this pool.
+      void write_image(std::ostream&) const;
+
       const ipr::String& intern(word_view);
+      // Intern each word of `ws` into the corresponding element of `out`, which shall be at
+      // least as long.  Words are taken by batches: the hash codes of all words of a batch are
+      // computed, and their table slots prefetched, before any of them is looked up, so that the
+      // cache misses of the lookups of a batch overlap instead of being paid one after the other.
+      void intern(std::span<const word_view> ws, std::span<const ipr::String*> out);
+      // One past the greatest identification number of the strings interned so far.
+      std::uint32_t id_bound() const;
    private:
       util::string::arena strings;
+      std::deque<impl::String> words;
+      string_table table;
+      // The image this pool is layered over, if any, and the nodes of its strings interned so far,
+      // indexed by position in the image.
+      const string_image* base = nullptr;
+      std::deque<impl::String> base_words;
+      std::vector<const impl::String*> base_nodes;
+
+      const ipr::String& intern(word_view, hash_code);
+   };
+
+   // String pool shareable by threads interning words concurrently, e.g. by the lexicons of a
+   // parallel front-end, so that equal words are interned as the same String node across threads.
+   // Words are sharded by hash code.  Each shard has a table and String nodes of its own, guarded
+   // by a reader-writer lock: lookups of words already interned proceed concurrently, and
+   // insertions only contend with operations on the same shard.  The characters of new words are
+   // copied into an arena of the interning thread, before the shard is locked for writing.
+   export struct shared_string_pool {
+      shared_string_pool();
+      const ipr::String& intern(word_view);
+      // One past the greatest identification number of the strings interned so far.
+      std::uint32_t id_bound() const { return next_id.load(); }
+   private:
+      static constexpr std::size_t shard_count = 64;
+
+      // Shards are aligned on cache lines, so that threads working on distinct shards do not
+      // contend for the same cache lines.
+      struct alignas(64) shard {
+         std::shared_mutex lock;
+         std::deque<impl::String> words;
+         string_table table;
+      };
+
+      // Storage of the characters of the words interned by a thread.  Owned by the pool, so that
+      // the characters outlive the thread.
+      struct thread_arena {
+         explicit thread_arena(std::thread::id t) : thread{ t } { }
+         const std::thread::id thread;
+         util::string::arena strings;
+      };
+
+      shard shards[shard_count];
+      std::atomic<std::uint32_t> next_id;
+      const std::uint64_t serial;            // identifies this pool to the threads using it
+      std::mutex arenas_lock;
+      std::deque<thread_arena> arenas;
+
+      util::string::arena& arena_of_this_thread();
    };
 }
 
+namespace ipr::impl {
+   // Three-way comparison of interned strings by identification number, a total order cheaper
+   // than the lexicographical order where any total order does.  Strings not interned by a pool
+   // sort after interned strings, in lexicographical order.
+   export inline int compare_interned(const ipr::String& lhs, const ipr::String& rhs)
+   {
+      const auto x = util::intern_id(lhs);
+      const auto y = util::intern_id(rhs);
+      if (x == String::unnumbered and y == String::unnumbered) [[unlikely]]
+         return compare(lhs, rhs);
+      return compare(x, y);
+   }
+}
+
 // -----------------------------------------------
 // -- Parameters (needed before cxx_form::impl) --
 // -----------------------------------------------
@@ -2596,22 +2885,22 @@ namespace ipr::impl {
       util::rb_tree::container<impl::Transfer_from_cc> xfer_ccs;
       util::rb_tree::container<impl::Transfer> xfers;
 
-      util::rb_tree::container<impl::extended_type> extendeds;
-      util::rb_tree::container<impl::Array> arrays;
-      util::rb_tree::container<impl::As_type> type_refs;
+      util::unique_table<impl::extended_type> extendeds;
+      util::unique_table<impl::Array> arrays;
+      util::unique_table<impl::As_type> type_refs;
       util::rb_tree::container<impl::As_type_with_transfer> type_xfers;
-      util::rb_tree::container<impl::Tor> tors;
-      util::rb_tree::container<impl::Function> functions;
+      util::unique_table<impl::Tor> tors;
+      util::unique_table<impl::Function> functions;
       util::rb_tree::container<impl::Function_with_transfer> fun_xfers;
-      util::rb_tree::container<impl::Pointer> pointers;
-      util::rb_tree::container<impl::Product> products;
-      util::rb_tree::container<impl::Ptr_to_member> member_ptrs;
-      util::rb_tree::container<impl::Qualified> qualifieds;
-      util::rb_tree::container<impl::Reference> references;
-      util::rb_tree::container<impl::Rvalue_reference> refrefs;
-      util::rb_tree::container<impl::Sum> sums;
-      util::rb_tree::container<impl::Forall> foralls;
-      util::rb_tree::container<ref_sequence<ipr::Type>> type_seqs;
+      util::unique_table<impl::Pointer> pointers;
+      util::unique_table<impl::Product> products;
+      util::unique_table<impl::Ptr_to_member> member_ptrs;
+      util::unique_table<impl::Qualified> qualifieds;
+      util::unique_table<impl::Reference> references;
+      util::unique_table<impl::Rvalue_reference> refrefs;
+      util::unique_table<impl::Sum> sums;
+      util::unique_table<impl::Forall> foralls;
+      util::unique_table<ref_sequence<ipr::Type>> type_seqs;
       stable_farm<impl::Decltype> decltypes;
       stable_farm<impl::Enum> enums;
       stable_farm<impl::Class> classes;
@@ -2622,9 +2911,28 @@ namespace ipr::impl {
    };
 
    export struct name_factory {
+      // Intern strings into a pool shared with other factories, instead of a pool of this
+      // factory's own.  To be called before any string is requested from this factory.
+      // Note: The shared pool shall outlive this factory.
+      void share_strings(util::shared_string_pool& pool) { shared_strings = &pool; }
+
+      // Layer the string pool of this factory over an image of strings; see string_pool::layer_over.
+      // Note: The image shall outlive this factory.
+      void layer_strings_over(const util::string_image& image) { strings.layer_over(image); }
+
+      // One past the greatest identification number of the strings of this factory.
+      std::uint32_t string_id_bound() const;
+
       const ipr::String& get_string(util::word_view);
+      // Identifiers and operators are unified by the address of their string: those requested by
+      // spelling, or from the strings returned by get_string, are unified by characters.
       const ipr::Identifier& get_identifier(const ipr::String&);
       const ipr::Identifier& get_identifier(util::word_view);
+      // Store the identifiers spelled by `words` into the corresponding elements of `out`, which
+      // shall be at least as long, and return the part of `out` so filled.  Faster than
+      // successive calls to get_identifier when the strings are not in cache; see string_pool.
+      std::span<const ipr::Identifier*>
+      get_identifiers(std::span<const util::word_view> words, std::span<const ipr::Identifier*> out);
       const ipr::Suffix& get_suffix(const ipr::Identifier&);
       const ipr::Operator& get_operator(const ipr::String&);
       const ipr::Operator& get_operator(util::word_view);
@@ -2635,14 +2943,15 @@ namespace ipr::impl {
       const ipr::Logogram& get_logogram(const ipr::String&);
    private:
       util::string_pool strings;
+      util::shared_string_pool* shared_strings = nullptr;
       util::rb_tree::container<impl::Logogram> logos;
-      util::rb_tree::container<impl::Identifier> ids;
-      util::rb_tree::container<impl::Suffix> suffixes;
-      util::rb_tree::container<impl::Conversion> convs;
-      util::rb_tree::container<impl::Ctor_name> ctors;
-      util::rb_tree::container<impl::Dtor_name> dtors;
-      util::rb_tree::container<impl::Operator> ops;
-      util::rb_tree::container<impl::Guide_name> guide_ids;
+      util::unique_table<impl::Identifier> ids;
+      util::unique_table<impl::Suffix> suffixes;
+      util::unique_table<impl::Conversion> convs;
+      util::unique_table<impl::Ctor_name> ctors;
+      util::unique_table<impl::Dtor_name> dtors;
+      util::unique_table<impl::Operator> ops;
+      util::unique_table<impl::Guide_name> guide_ids;
    };
 
    export struct expr_factory : name_factory {
@@ -2924,6 +3233,11 @@ namespace ipr::impl {
                               // -- impl::Lexicon --
    export struct Lexicon : ipr::Lexicon, type_factory, stmt_factory {
       Lexicon();
+      // Lexicon interning its strings into a pool shared with other lexicons.
+      explicit Lexicon(util::shared_string_pool&);
+      // Lexicon interning its strings over an image of strings, e.g. the common vocabulary of
+      // a library, mapped from a file.
+      explicit Lexicon(const util::string_image&);
       ~Lexicon();
 
       const ipr::Language_linkage& cxx_linkage() const final;
@@ -14,8 +14,14 @@ module;
 #include <bit>
 #include <cassert>
 #include <cstring>
+#include <limits>
 #include <typeinfo>
 
+#if defined(__x86_64__) || defined(_M_X64)
+#  define IPR_IMPL_SSE2
+#  include <emmintrin.h>
+#endif
+
 module cxx.ipr.impl;
 
 import cxx.ipr.traversal;   // for util::view
@@ -117,13 +123,49 @@ namespace ipr::impl {
         // Ensure the table of statically known words is lexicographically sorted.
         static_assert(std::is_sorted(std::begin(known_words), std::end(known_words), word_less));
 
-        // less-than comparator for known words (which are all constexpr data)
-        constexpr auto word_lt = [](auto& x, auto& y) { return x.text() < y; };
+        // Perfect hash over the known words: mixes the length of a word with its first, middle,
+        // and last characters, and keeps the top bits.  The seed was picked so that no two entries
+        // of `known_words` land in the same slot; should an edit of the table introduce a collision,
+        // the static_assert below fires and another seed must be searched for.
+        constexpr std::uint64_t known_word_seed = 1204;
+        constexpr int known_word_bits = 8;
+
+        constexpr std::size_t known_word_slot(util::word_view w)
+        {
+           const std::uint64_t keys[] { w.size(), w.front(), w[w.size() / 2], w.back() };
+           auto h = known_word_seed;
+           for (auto k : keys)
+           {
+              h = (h ^ k) * 0x9E3779B97F4A7C15;
+              h ^= h >> 29;
+           }
+           return h >> (64 - known_word_bits);
+        }
 
-        constexpr const auto* word_if_known(util::word_view w)
+        // Slot table of the perfect hash: 1 + the position of the known word hashing to a slot,
+        // or 0 if no known word does.
+        static_assert(std::size(known_words) < 256);
+        constexpr auto known_word_slots = [] {
+           std::array<std::uint8_t, std::size_t{1} << known_word_bits> slots { };
+           for (std::size_t i = 0; i < std::size(known_words); ++i)
+              slots[known_word_slot(known_words[i].text())] = static_cast<std::uint8_t>(i + 1);
+           return slots;
+        }();
+
+        // Ensure the perfect hash is collision-free: every known word owns a distinct slot.
+        static_assert(std::count_if(known_word_slots.begin(), known_word_slots.end(),
+                                    [](auto s) { return s != 0; }) == std::size(known_words));
+
+        // Return a pointer to the known word spelled `w`, if any.  One hash, one probe, and at most one
+        // string comparison, whether `w` is known or not.
+        constexpr const std_identifier* word_if_known(util::word_view w)
         {
-            auto place = std::lower_bound(std::begin(known_words), std::end(known_words), w, word_lt);
-            return place >= std::end(known_words) or place->text() != w ? nullptr : &*place;
+            if (w.empty())
+               return nullptr;
+            const auto slot = known_word_slots[known_word_slot(w)];
+            if (slot == 0 or known_words[slot - 1].text() != w)
+               return nullptr;
+            return &known_words[slot - 1];
         }
 
         // Return the String representation for a known word.
@@ -263,25 +305,494 @@ namespace ipr::impl {
 }
 
 namespace ipr::util {
-    const ipr::String& string_pool::intern(word_view w)
-    {
-       if (w.empty())
+   namespace {
+      // Control byte of a vacant slot of a string table.  Control bytes of occupied slots have
+      // their high bit cleared.
+      constexpr std::uint8_t vacant = 0x80;
+
+      // Portion of a hash code stored in the control byte of a slot.
+      constexpr std::uint8_t control_byte(hash_code h)
+      {
+         return static_cast<std::size_t>(h) & 0x7F;
+      }
+
+      // Portion of a hash code selecting the first group probed.
+      constexpr std::size_t probe_start(hash_code h)
+      {
+         return static_cast<std::size_t>(h) >> 7;
+      }
+
+#ifdef IPR_IMPL_SSE2
+      // Control bytes of a group of slots, matched 16 at a time with SSE2 instructions.
+      // A match is a bit mask, with one bit per slot.
+      struct control_group {
+         static constexpr std::size_t width = 16;
+         static constexpr int stride = 1;
+
+         explicit control_group(const std::uint8_t* p)
+            : bytes{ _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)) }
+         { }
+
+         std::uint64_t match(std::uint8_t c) const
+         {
+            return static_cast<std::uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(c))));
+         }
+
+         std::uint64_t match_vacant() const
+         {
+            return static_cast<std::uint16_t>(_mm_movemask_epi8(bytes));
+         }
+
+      private:
+         __m128i bytes;
+      };
+#else
+      // Control bytes of a group of slots, matched 8 at a time within a machine word.
+      // A match is a bit mask, with the high bit of each matched byte set.
+      struct control_group {
+         static constexpr std::size_t width = 8;
+         static constexpr int stride = 8;
+
+         explicit control_group(const std::uint8_t* p)
+         {
+            std::memcpy(&bytes, p, sizeof bytes);
+            if constexpr (std::endian::native == std::endian::big)
+               bytes = std::byteswap(bytes);
+         }
+
+         // Note: A byte above a matched byte may be spuriously flagged; matches are confirmed anyway.
+         std::uint64_t match(std::uint8_t c) const
+         {
+            const auto x = bytes ^ (ones * c);
+            return (x - ones) & ~x & highs;
+         }
+
+         std::uint64_t match_vacant() const { return bytes & highs; }
+
+      private:
+         static constexpr auto ones = ~std::uint64_t{} / 0xFF;         // 0x0101...01
+         static constexpr auto highs = ones << 7;                      // 0x8080...80
+         std::uint64_t bytes;
+      };
+#endif
+
+      // Number of slots of a string table when first used.
+      constexpr std::size_t initial_capacity = 4 * control_group::width;
+
+      // Offset, within a group, of the slot designated by the lowest bit of a match.
+      inline std::size_t lowest_match(std::uint64_t m)
+      {
+         return std::countr_zero(m) / control_group::stride;
+      }
+
+      // Hint the processor to bring the cache line holding `p` into cache.
+      inline void prefetch_line(const void* p)
+      {
+#if defined(IPR_IMPL_SSE2)
+         _mm_prefetch(static_cast<const char*>(p), _MM_HINT_T0);
+#elif defined(__GNUC__)
+         __builtin_prefetch(p);
+#endif
+      }
+
+      inline hash_code hash_word(word_view w)
+      {
+         return hash_code{ std::hash<word_view>{ }(w) };
+      }
+
+      // Number of words whose lookups are overlapped by string_pool::intern.  Large enough to hide
+      // the latency of a cache miss, small enough for the prefetched lines to stay in the L1 cache.
+      constexpr std::size_t intern_batch_size = 16;
+   }
+
+   const impl::String* string_table::find(word_view w, hash_code h) const
+   {
+      if (slots.empty())
+         return nullptr;
+      const auto mask = slots.size() - 1;
+      const auto c = control_byte(h);
+      // Groups are probed quadratically; every group is visited as the capacity is a power of 2.
+      auto pos = probe_start(h) & mask;
+      for (std::size_t step = control_group::width; ; step += control_group::width)
+      {
+         const control_group group { &controls[pos] };
+         for (auto m = group.match(c); m != 0; m &= m - 1)
+         {
+            auto& s = slots[(pos + lowest_match(m)) & mask];
+            if (s.hash == h and s.string->characters() == w)
+               return s.string;
+         }
+         if (group.match_vacant() != 0)
+            return nullptr;
+         pos = (pos + step) & mask;
+      }
+   }
+
+   void string_table::prefetch(hash_code h) const
+   {
+      if (slots.empty())
+         return;
+      const auto pos = probe_start(h) & (slots.size() - 1);
+      prefetch_line(&controls[pos]);
+      prefetch_line(&slots[pos]);
+   }
+
+   void string_table::insert(const impl::String& s, hash_code h)
+   {
+      // Keep the load factor at most 7/8.
+      if (8 * (count + 1) > 7 * slots.size())
+         grow();
+      enter({ h, &s });
+      ++count;
+   }
+
+   // Store an entry in the first vacant slot of its probe sequence.
+   void string_table::enter(const slot& entry)
+   {
+      const auto mask = slots.size() - 1;
+      auto pos = probe_start(entry.hash) & mask;
+      for (std::size_t step = control_group::width; ; step += control_group::width)
+      {
+         if (auto m = control_group{ &controls[pos] }.match_vacant())
+         {
+            const auto n = (pos + lowest_match(m)) & mask;
+            slots[n] = entry;
+            controls[n] = control_byte(entry.hash);
+            if (n < control_group::width)
+               controls[slots.size() + n] = controls[n];
+            return;
+         }
+         pos = (pos + step) & mask;
+      }
+   }
+
+   void string_table::grow()
+   {
+      const auto capacity = slots.empty() ? initial_capacity : 2 * slots.size();
+      auto previous = std::exchange(slots, std::vector<slot>(capacity));
+      const auto previous_controls = std::exchange(controls, std::vector<std::uint8_t>(capacity + control_group::width, vacant));
+      for (std::size_t i = 0; i < previous.size(); ++i)
+      {
+         if (previous_controls[i] != vacant)
+            enter(previous[i]);
+      }
+   }
+
+   namespace {
+      // Identification number of the first word interned by a string pool.
+      constexpr std::uint32_t first_pooled_id = std::size(impl::known_words) + 1;
+   }
+
+   std::uint32_t intern_id(const ipr::String& s)
+   {
+      if (&s == &ipr::String::empty_string())
+         return 0;
+      // A known word is the string of an entry of the table of known words; its position in that
+      // table is found from its address.
+      const auto where = reinterpret_cast<std::uintptr_t>(&s);
+      const auto first = reinterpret_cast<std::uintptr_t>(&impl::known_words[0].operand());
+      if (where >= first and where < first + sizeof impl::known_words)
+         return 1 + (where - first) / sizeof impl::known_words[0];
+      // ipr::String may be implemented by clients; only an impl::String carries a number.
+      if (typeid(s) != typeid(impl::String))
+         return impl::String::unnumbered;
+      return static_cast<const impl::String&>(s).intern_id();
+   }
+
+   namespace {
+      // Layout of a string image, with numbers in the byte order of the host:
+      //   - a header;
+      //   - an entry per string: its hash code, and the offset and length of its characters;
+      //   - the lookup table, linearly probed: per slot, 1 + the position of a string, or 0 if vacant;
+      //   - the characters of the strings.
+      // The lookup table is at most half full.
+      struct image_header {
+         char8_t magic[8];
+         std::uint32_t version;
+         std::uint32_t count;                // number of strings
+         std::uint64_t capacity;             // number of slots of the lookup table, a power of 2
+         std::uint64_t fingerprint;          // see hash_fingerprint
+      };
+
+      constexpr char8_t image_magic[8] { u8'I', u8'P', u8'R', u8'-', u8'S', u8'T', u8'R', 0 };
+      constexpr std::uint32_t image_version = 1;
+      constexpr std::size_t entry_size = 16;
+      constexpr std::size_t slot_size = 4;
+
+      // Hash code of a fixed word, recorded in an image to detect a build hashing differently.
+      std::uint64_t hash_fingerprint()
+      {
+         return static_cast<std::uint64_t>(hash_word(u8"ipr::util::string_image"));
+      }
+
+      // The sections of an image need not be suitably aligned in memory; their numbers are copied.
+      template<typename T>
+      T load(const char8_t* p)
+      {
+         T x;
+         std::memcpy(&x, p, sizeof x);
+         return x;
+      }
+
+      template<typename T>
+      void store(std::ostream& os, const T& x)
+      {
+         os.write(reinterpret_cast<const char*>(&x), sizeof x);
+      }
+
+      [[noreturn]] void invalid_image(const char* why)
+      {
+         throw std::runtime_error(std::string("invalid string image: ") + why);
+      }
+   }
+
+   string_image::string_image(std::span<const char8_t> b) : bytes{ b }
+   {
+      image_header header;
+      if (bytes.size() < sizeof header)
+         invalid_image("truncated header");
+      std::memcpy(&header, bytes.data(), sizeof header);
+      if (not std::equal(std::begin(image_magic), std::end(image_magic), header.magic)
+          or header.version != image_version)
+         invalid_image("unknown format");
+      if (header.fingerprint != hash_fingerprint())
+         invalid_image("written by a build with another hash function");
+      if (not std::has_single_bit(header.capacity) or header.capacity <= header.count
+          or header.capacity > bytes.size())
+         invalid_image("bad lookup table capacity");
+      const auto chars_offset = sizeof header + header.count * entry_size + header.capacity * slot_size;
+      if (chars_offset > bytes.size())
+         invalid_image("truncated tables");
+
+      count = header.count;
+      mask = header.capacity - 1;
+      entries = bytes.data() + sizeof header;
+      table = entries + count * entry_size;
+      chars = bytes.data() + chars_offset;
+
+      // Check the extents of the strings and the positions in the lookup table once and for all,
+      // so that lookups need not.  A vacant slot ends every probe sequence.
+      const std::uint64_t chars_size = bytes.size() - chars_offset;
+      for (std::uint32_t i = 0; i < count; ++i)
+      {
+         const auto e = entries + i * entry_size;
+         if (std::uint64_t{ load<std::uint32_t>(e + 8) } + load<std::uint32_t>(e + 12) > chars_size)
+            invalid_image("string out of bounds");
+      }
+      std::size_t vacancies = 0;
+      for (std::size_t pos = 0; pos <= mask; ++pos)
+      {
+         const auto n = load<std::uint32_t>(table + pos * slot_size);
+         if (n > count)
+            invalid_image("bad string position");
+         vacancies += n == 0;
+      }
+      if (vacancies != header.capacity - count)
+         invalid_image("corrupted lookup table");
+   }
+
+   std::uint32_t string_image::find(word_view w, hash_code h) const
+   {
+      for (auto pos = static_cast<std::size_t>(h) & mask; ; pos = (pos + 1) & mask)
+      {
+         const auto n = load<std::uint32_t>(table + pos * slot_size);
+         if (n == 0)
+            return absent;
+         if (load<std::uint64_t>(entries + (n - 1) * entry_size) == static_cast<std::uint64_t>(h)
+             and characters(n - 1) == w)
+            return n - 1;
+      }
+   }
+
+   word_view string_image::characters(std::uint32_t n) const
+   {
+      const auto e = entries + n * entry_size;
+      return { chars + load<std::uint32_t>(e + 8), load<std::uint32_t>(e + 12) };
+   }
+
+   void string_image::prefetch(hash_code h) const
+   {
+      prefetch_line(table + (static_cast<std::size_t>(h) & mask) * slot_size);
+   }
+
+   void string_pool::layer_over(const string_image& image)
+   {
+      assert(base == nullptr and table.size() == 0);
+      base = &image;
+      base_nodes.assign(image.size(), nullptr);
+   }
+
+   void string_pool::write_image(std::ostream& os) const
+   {
+      // The strings are written in order of identification number, which is their order of
+      // interning, so that a pool layered over the image numbers them alike.
+      std::vector<word_view> texts;
+      texts.reserve(base_nodes.size() + words.size());
+      for (std::uint32_t n = 0; n < base_nodes.size(); ++n)
+         texts.push_back(base->characters(n));
+      for (auto& w : words)
+         texts.push_back(w.characters());
+      if (texts.size() >= string_image::absent)
+         throw std::length_error("too many strings for a string image");
+
+      const image_header header {
+         { image_magic[0], image_magic[1], image_magic[2], image_magic[3],
+           image_magic[4], image_magic[5], image_magic[6], image_magic[7] },
+         image_version,
+         static_cast<std::uint32_t>(texts.size()),
+         std::bit_ceil(2 * texts.size() + 1),
+         hash_fingerprint(),
+      };
+      store(os, header);
+
+      const auto mask = header.capacity - 1;
+      std::vector<std::uint32_t> slots(header.capacity);
+      std::uint64_t offset = 0;
+      for (std::uint32_t n = 0; n < texts.size(); ++n)
+      {
+         const auto h = hash_word(texts[n]);
+         if (offset + texts[n].size() > std::numeric_limits<std::uint32_t>::max())
+            throw std::length_error("too many characters for a string image");
+         store(os, static_cast<std::uint64_t>(h));
+         store(os, static_cast<std::uint32_t>(offset));
+         store(os, static_cast<std::uint32_t>(texts[n].size()));
+         offset += texts[n].size();
+         auto pos = static_cast<std::size_t>(h) & mask;
+         while (slots[pos] != 0)
+            pos = (pos + 1) & mask;
+         slots[pos] = n + 1;
+      }
+      os.write(reinterpret_cast<const char*>(slots.data()), slots.size() * slot_size);
+      for (auto t : texts)
+         os.write(reinterpret_cast<const char*>(t.data()), t.size());
+   }
+
+   std::uint32_t string_pool::id_bound() const
+   {
+      return first_pooled_id + base_nodes.size() + table.size();
+   }
+
+   const ipr::String& string_pool::intern(word_view w)
+   {
+      if (w.empty())
          return ipr::String::empty_string();
 
-        // For statically known words, just return the statically allocated address.
-        if (const auto p = impl::word_if_known(w))
-            return p->string();
+      // For statically known words, just return the statically allocated address.
+      if (const auto p = impl::word_if_known(w))
+         return p->string();
+
+      return intern(w, hash_word(w));
+   }
+
+   // Dynamically allocated words are entered, with their hash codes, into an open-addressing table.
+   const ipr::String& string_pool::intern(word_view w, hash_code h)
+   {
+      // The strings of the image are interned without copying their characters.
+      if (base != nullptr)
+      {
+         if (const auto n = base->find(w, h); n != string_image::absent)
+         {
+            auto& node = base_nodes[n];
+            if (node == nullptr)
+               node = &base_words.emplace_back(base->characters(n), first_pooled_id + n);
+            return *node;
+         }
+      }
+      if (const auto p = table.find(w, h))
+         return *p;
+      assert(id_bound() != impl::String::unnumbered);
+      const auto fresh = strings.make_string(w.data(), w.length());
+      auto& word = words.emplace_back(util::word_view(fresh->data, fresh->length), id_bound());
+      table.insert(word, h);
+      return word;
+   }
 
-        // Dynamically allocated words are slotted by their hash codes into singly-linked lists.
-        const hash_code h { std::hash<word_view>{ }(w) };
-        auto& bucket = (*this)[h];
-        const auto eq = [&w](auto& x) { return x.characters() == w; };
-        if (const auto p = std::find_if(bucket.begin(), bucket.end(), eq); p != bucket.end())
+   void string_pool::intern(std::span<const word_view> ws, std::span<const ipr::String*> out)
+   {
+      assert(out.size() >= ws.size());
+      hash_code hashes[intern_batch_size];
+      for (std::size_t first = 0; first < ws.size(); first += intern_batch_size)
+      {
+         const auto n = std::min(intern_batch_size, ws.size() - first);
+         // Resolve the empty and known words right away, and prefetch the slots of the others.
+         for (std::size_t i = 0; i < n; ++i)
+         {
+            const auto w = ws[first + i];
+            if (w.empty())
+               out[first + i] = &ipr::String::empty_string();
+            else if (const auto p = impl::word_if_known(w))
+               out[first + i] = &p->string();
+            else
+            {
+               out[first + i] = nullptr;
+               hashes[i] = hash_word(w);
+               if (base != nullptr)
+                  base->prefetch(hashes[i]);
+               table.prefetch(hashes[i]);
+            }
+         }
+         // Insertions may grow the table, leaving later prefetches useless but harmless.
+         for (std::size_t i = 0; i < n; ++i)
+         {
+            if (out[first + i] == nullptr)
+               out[first + i] = &intern(ws[first + i], hashes[i]);
+         }
+      }
+   }
+
+   namespace {
+      // Source of the serial numbers of shared string pools; 0 is taken by no pool.
+      std::atomic<std::uint64_t> shared_pool_serials { 0 };
+   }
+
+   shared_string_pool::shared_string_pool() : next_id{ first_pooled_id }, serial{ ++shared_pool_serials } { }
+
+   util::string::arena& shared_string_pool::arena_of_this_thread()
+   {
+      // A thread remembers the arena it used last, along with the serial number of its pool, so
+      // that the arenas of a pool are searched only when the thread turns to another pool.
+      thread_local std::uint64_t cached_serial = 0;
+      thread_local util::string::arena* cached_arena = nullptr;
+      if (cached_serial == serial)
+         return *cached_arena;
+      const auto self = std::this_thread::get_id();
+      std::lock_guard guard { arenas_lock };
+      const auto p = std::ranges::find(arenas, self, &thread_arena::thread);
+      auto& arena = p != arenas.end() ? p->strings : arenas.emplace_back(self).strings;
+      cached_serial = serial;
+      cached_arena = &arena;
+      return arena;
+   }
+
+   const ipr::String& shared_string_pool::intern(word_view w)
+   {
+      if (w.empty())
+         return ipr::String::empty_string();
+      if (const auto p = impl::word_if_known(w))
+         return p->string();
+
+      // The shard is selected by the high bits of the hash code, which the table of the shard
+      // makes no use of.
+      const auto h = hash_word(w);
+      auto& s = shards[static_cast<std::size_t>(h) >> (std::numeric_limits<std::size_t>::digits - 6)];
+      static_assert(shard_count == 1 << 6);
+      {
+         std::shared_lock read { s.lock };
+         if (const auto p = s.table.find(w, h))
             return *p;
-        const auto fresh = strings.make_string(w.data(), w.length());
-        bucket.emplace_front(util::word_view(fresh->data, fresh->length));
-        return bucket.front();
-    }
+      }
+      // Copy the characters outside of the writer lock.  Should another thread intern the word
+      // since the lookup, the copy is left unused in the arena.
+      const auto fresh = arena_of_this_thread().make_string(w.data(), w.length());
+      std::unique_lock write { s.lock };
+      if (const auto p = s.table.find(w, h))
+         return *p;
+      const auto id = next_id++;
+      assert(id != impl::String::unnumbered);
+      auto& word = s.words.emplace_back(util::word_view(fresh->data, fresh->length), id);
+      s.table.insert(word, h);
+      return word;
+   }
 }
 
 namespace ipr::cxx_form::impl {
@@ -1088,35 +1599,49 @@ namespace ipr::impl {
          }
       };
 
-      struct id_compare
+      // A node with a single operand is unique for that operand, hence looked up by its address,
+      // of hash code `h`.
+      template<typename T, typename Operand>
+      const T& unique_unary(util::unique_table<T>& table, const Operand& x, util::hash_code h)
       {
-          int operator()(const ipr::Identifier& lhs, const ipr::String& rhs) const
-          {
-              return impl::compare(lhs.string(), rhs);
-          }
+         constexpr auto eq = [](const T& n, const Operand& y) { return &n.operand() == &y; };
+         return *table.insert(x, h, eq);
+      }
 
-          int operator()(const ipr::String& lhs, const ipr::Identifier& rhs) const
-          {
-              return impl::compare(lhs, rhs.string());
-          }
-      };
+      template<typename T, typename Operand>
+      const T& unique_unary(util::unique_table<T>& table, const Operand& x)
+      {
+         return unique_unary(table, x, util::hash_address(&x));
+      }
 
+      // Type nodes are hash-consed by structural hash codes, computed from the identities of their
+      // operands; the operands of a node are compared only when its hash code matches.
+      inline util::hash_code operand_hash(const ipr::Node& x) { return util::hash_address(&x); }
+      inline util::hash_code operand_hash(ipr::Qualifiers q) { return util::hash_code{ static_cast<std::size_t>(q) }; }
 
-      // >>>> Yuriy Solodkyy: 2008/07/10
-      // This comparison would be used to unify Unary nodes: on LHS we would be
-      // called with a type for which Pointer (Reference/sizeof etc.) is created,
-      // on RHS we would be called with already allocated Pointer types. Thus we
-      // have to check whether any of the existing Pointer types does not already
-      // have a points_to (its operand()) equal to the type in LHS.
-      struct unified_type_compare
+      template<typename... Operands>
+      util::hash_code structural_hash(const Operands&... xs)
       {
-          template<class Cat, class Operand>
-          int operator()(const ipr::Unary<Cat,Operand>& lhs, const ipr::Type& rhs) const
-          {
-              return impl::compare(lhs.operand(), rhs);
-          }
-      };
-      // <<<< Yuriy Solodkyy: 2008/07/10
+         util::hash_code h { };
+         ((h = util::hash_combine(h, operand_hash(xs))), ...);
+         return h;
+      }
+
+      util::hash_code sequence_hash(const ipr::Sequence<ipr::Type>& seq)
+      {
+         util::hash_code h { static_cast<std::size_t>(seq.size()) };
+         for (auto& t : seq)
+            h = util::hash_combine(h, operand_hash(t));
+         return h;
+      }
+
+      // The node of a table equal to the node made from `key`, according to the three-way
+      // comparison `cmp`, given the structural hash code `h` of `key`.
+      template<typename T, typename Key, typename Compare>
+      const T& unique_type(util::unique_table<T>& table, const Key& key, util::hash_code h, Compare cmp)
+      {
+         return *table.insert(key, h, [cmp](const T& x, const Key& y) { return cmp(x, y) == 0; });
+      }
 
       const ipr::Transfer& type_factory::get_transfer_from_linkage(const ipr::Language_linkage& l)
       {
@@ -1144,7 +1669,7 @@ namespace ipr::impl {
       const ipr::Array& type_factory::get_array(const ipr::Type& t, const ipr::Expr& b)
       {
          using rep = impl::Array::Rep;
-         return *arrays.insert(rep{ t, b }, binary_compare());
+         return unique_type(arrays, rep{ t, b }, structural_hash(t, b), binary_compare());
       }
 
       const ipr::Qualified&
@@ -1157,7 +1682,7 @@ namespace ipr::impl {
                ("type_factoy::get_qualified: no qualifier");
 
          using rep = impl::Qualified::Rep;
-         return *qualifieds.insert(rep{ q, t }, binary_compare());
+         return unique_type(qualifieds, rep{ q, t }, structural_hash(q, t), binary_compare());
       }
 
       const ipr::Decltype& type_factory::get_decltype(const ipr::Expr& e)
@@ -1173,12 +1698,13 @@ namespace ipr::impl {
             if (physically_same(t.name(), id))
                return t;
          }
-         return *extendeds.insert(id, unary_compare());
+         constexpr auto eq = [](auto& x, auto& y) { return physically_same(x.name(), y) ? 0 : 1; };
+         return unique_type(extendeds, id, util::hash_address(&id), eq);
       }
 
       const ipr::As_type& type_factory::get_as_type(const ipr::Expr& e)
       {
-         return *type_refs.insert(e, unary_compare());
+         return unique_unary(type_refs, e);
       }
 
       const ipr::As_type&
@@ -1231,7 +1757,7 @@ namespace ipr::impl {
       const ipr::Tor& type_factory::get_tor(const ipr::Product& s, const ipr::Sum& e)
       {
          using rep = impl::Tor::Rep;
-         return *tors.insert(rep{ s, e }, binary_compare());
+         return unique_type(tors, rep{ s, e }, structural_hash(s, e), binary_compare());
       }
 
       const ipr::Function& type_factory::get_function(const ipr::Product& s, const ipr::Type& t)
@@ -1250,7 +1776,7 @@ namespace ipr::impl {
                                  const ipr::Expr& e)
       {
          using rep = impl::Function::Rep;
-         return *functions.insert(rep{ s, t, e }, ternary_compare());
+         return unique_type(functions, rep{ s, t, e }, structural_hash(s, t, e), ternary_compare());
       }
 
       const ipr::Function&
@@ -1284,53 +1810,55 @@ namespace ipr::impl {
 
       const ipr::Pointer& type_factory::get_pointer(const ipr::Type& t)
       {
-         // >>>> Yuriy Solodkyy: 2008/07/10
-         // Fixed pointer comparison for unification
-         return *pointers.insert(t, unified_type_compare());
-         // <<<< Yuriy Solodkyy: 2008/07/10
+         return unique_unary(pointers, t);
       }
 
       const ipr::Product& type_factory::get_product(const ipr::Sequence<ipr::Type>& seq)
       {
-         return *products.insert(seq, unary_lexicographic_compare());
+         return unique_type(products, seq, sequence_hash(seq), unary_lexicographic_compare());
       }
 
+      // The elements of a warehouse are copied into a sequence of the factory, the first time.
       const ipr::Product& type_factory::get_product(const Warehouse<ipr::Type>& seq)
       {
-         return get_product(*type_seqs.insert(seq.rep(), unary_lexicographic_compare()));
+         const auto h = sequence_hash(seq.rep());
+         auto& types = unique_type(type_seqs, seq.rep(), h, unary_lexicographic_compare());
+         return unique_type(products, types, h, unary_lexicographic_compare());
       }
 
       const ipr::Ptr_to_member&
       type_factory::get_ptr_to_member(const ipr::Type& c, const ipr::Type& t)
       {
          using rep = impl::Ptr_to_member::Rep;
-         return *member_ptrs.insert(rep{ c, t }, binary_compare());
+         return unique_type(member_ptrs, rep{ c, t }, structural_hash(c, t), binary_compare());
       }
 
       const ipr::Reference& type_factory::get_reference(const ipr::Type& t)
       {
-         return *references.insert(t, unified_type_compare());
+         return unique_unary(references, t);
       }
 
       const ipr::Rvalue_reference& type_factory::get_rvalue_reference(const ipr::Type& t)
       {
-         return *refrefs.insert(t, unified_type_compare());
+         return unique_unary(refrefs, t);
       }
 
       const ipr::Sum& type_factory::get_sum(const ipr::Sequence<ipr::Type>& seq)
       {
-         return *sums.insert(seq, unary_lexicographic_compare());
+         return unique_type(sums, seq, sequence_hash(seq), unary_lexicographic_compare());
       }
 
       const ipr::Sum& type_factory::get_sum(const Warehouse<ipr::Type>& seq)
       {
-         return get_sum(*type_seqs.insert(seq.rep(), unary_lexicographic_compare()));
+         const auto h = sequence_hash(seq.rep());
+         auto& types = unique_type(type_seqs, seq.rep(), h, unary_lexicographic_compare());
+         return unique_type(sums, types, h, unary_lexicographic_compare());
       }
 
       const ipr::Forall& type_factory::get_forall(const ipr::Product& s, const ipr::Type& t)
       {
          using rep = impl::Forall::Rep;
-         return *foralls.insert(rep{ s, t }, binary_compare());
+         return unique_type(foralls, rep{ s, t }, structural_hash(s, t), binary_compare());
       }
 
       const ipr::Auto& type_factory::get_auto()
@@ -1654,52 +2182,94 @@ namespace ipr::impl {
 
       const ipr::String& name_factory::get_string(util::word_view w)
       {
+         if (shared_strings != nullptr)
+            return shared_strings->intern(w);
          return strings.intern(w);
       }
 
+      std::uint32_t name_factory::string_id_bound() const
+      {
+         if (shared_strings != nullptr)
+            return shared_strings->id_bound();
+         return strings.id_bound();
+      }
+
+      // Identifiers and operators are unified by characters: their strings are interned first.
       const ipr::Identifier& name_factory::get_identifier(const ipr::String& s)
       {
-         return *ids.insert(s, id_compare());
+         return unique_unary(ids, s);
       }
 
       const ipr::Identifier& name_factory::get_identifier(util::word_view w)
       {
-         return get_identifier(get_string(w));
+         return unique_unary(ids, get_string(w));
+      }
+
+      std::span<const ipr::Identifier*>
+      name_factory::get_identifiers(std::span<const util::word_view> words, std::span<const ipr::Identifier*> out)
+      {
+         assert(out.size() >= words.size());
+         // The strings are interned a chunk at a time, then their identifiers looked up by batches,
+         // the slots of a batch being prefetched before any of them is probed.
+         constexpr std::size_t chunk = 256;
+         const ipr::String* strs[chunk];
+         util::hash_code hashes[util::intern_batch_size];
+         for (std::size_t first = 0; first < words.size(); first += chunk)
+         {
+            const auto part = words.subspan(first, std::min(chunk, words.size() - first));
+            if (shared_strings != nullptr)
+               std::transform(part.begin(), part.end(), strs, [this](auto w) { return &shared_strings->intern(w); });
+            else
+               strings.intern(part, strs);
+            for (std::size_t i = 0; i < part.size(); i += util::intern_batch_size)
+            {
+               const auto n = std::min(util::intern_batch_size, part.size() - i);
+               for (std::size_t j = 0; j < n; ++j)
+               {
+                  hashes[j] = util::hash_address(strs[i + j]);
+                  ids.prefetch(hashes[j]);
+               }
+               // Insertions may grow the table, leaving later prefetches useless but harmless.
+               for (std::size_t j = 0; j < n; ++j)
+                  out[first + i + j] = &unique_unary(ids, *strs[i + j], hashes[j]);
+            }
+         }
+         return out.first(words.size());
       }
 
       const ipr::Suffix& name_factory::get_suffix(const ipr::Identifier& s)
       {
-         return *suffixes.insert(s, unary_compare());
+         return unique_unary(suffixes, s);
       }
 
       const ipr::Operator& name_factory::get_operator(const ipr::String& s)
       {
-         return *ops.insert(s, unary_compare());
+         return unique_unary(ops, s);
       }
 
       const ipr::Operator& name_factory::get_operator(util::word_view w)
       {
-         return get_operator(get_string(w));
+         return unique_unary(ops, get_string(w));
       }
 
       const ipr::Ctor_name& name_factory::get_ctor_name(const ipr::Type& t)
       {
-         return *ctors.insert(t, unary_compare());
+         return unique_unary(ctors, t);
       }
 
       const ipr::Dtor_name& name_factory::get_dtor_name(const ipr::Type& t)
       {
-         return *dtors.insert(t, unary_compare());
+         return unique_unary(dtors, t);
       }
 
       const ipr::Conversion& name_factory::get_conversion(const ipr::Type& t)
       {
-         return *convs.insert(t, unary_compare());
+         return unique_unary(convs, t);
       }
 
       const ipr::Guide_name& name_factory::get_guide_name(const ipr::Template& m)
       {
-         return *guide_ids.insert(m, unary_compare());
+         return unique_unary(guide_ids, m);
       }
 
       // ------------------------
@@ -2431,6 +3001,8 @@ namespace ipr::impl {
       }
 
       Lexicon::Lexicon() { }
+      Lexicon::Lexicon(util::shared_string_pool& pool) { share_strings(pool); }
+      Lexicon::Lexicon(const util::string_image& image) { layer_strings_over(image); }
       Lexicon::~Lexicon() { }
 
       const ipr::Literal&
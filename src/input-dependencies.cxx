@@ -0,0 +1,229 @@
+//
+// This file is part of The Pivot framework.
+// Written by Gabriel Dos Reis.
+// See LICENSE for copright and license notices.
+//
+
+#include <filesystem>
+#include <ostream>
+#include <string_view>
+#include "input-impl.hxx"
+
+namespace ipr::input {
+    namespace {
+        // Append to `name` the characters from the cursor up to, and including, the delimiter.
+        // Return false if the line ends before the delimiter.
+        template<typename Cursor>
+        bool gather_delimited(Cursor& cursor, char8_t delimiter, std::u8string& name)
+        {
+            name += *cursor;
+            for (cursor.advance(); not cursor.done(); cursor.advance())
+            {
+                name += *cursor;
+                if (*cursor == delimiter)
+                    return true;
+            }
+            return false;
+        }
+
+        // Return the operand of an `#include`, `#import`, or `#embed` directive.
+        template<typename Cursor>
+        std::u8string header_operand(Cursor& cursor)
+        {
+            std::u8string name;
+            if (*cursor == u8'<')
+                gather_delimited(cursor, u8'>', name);
+            else if (*cursor == u8'"')
+                gather_delimited(cursor, u8'"', name);
+            else
+            {
+                for (; not cursor.done(); cursor.advance())
+                    name += *cursor;
+                while (not name.empty() and white_space(name.back()))
+                    name.pop_back();
+            }
+            return name;
+        }
+
+        // Return the operand of an `import`, or `module`, directive: a header-name or a module-name.
+        template<typename Cursor>
+        std::u8string module_operand(Cursor& cursor)
+        {
+            if (*cursor == u8'<' or *cursor == u8'"')
+                return header_operand(cursor);
+            std::u8string name;
+            for (; not cursor.done() and *cursor != u8';' and *cursor != u8'['; cursor.advance())
+            {
+                if (not white_space(*cursor))
+                    name += *cursor;
+            }
+            return name;
+        }
+
+        // If the logical line delivered by the cursor, of species `s`, is a dependency line,
+        // append the corresponding dependency to `deps`.
+        template<typename Cursor>
+        void gather_dependency(Cursor cursor, LineSpecies s, std::uint64_t line, std::vector<Dependency>& deps)
+        {
+            char8_t buffer[8];
+            skip_blank(cursor);
+            const bool directive = *cursor == u8'#';
+            if (directive)
+            {
+                cursor.advance();
+                skip_blank(cursor);
+            }
+            gather_name(cursor, buffer);
+            auto sort = DependencySort::Include;
+            if (s == LineSpecies::Embed)
+                sort = DependencySort::Embed;
+            else if (directive)
+            {
+                // `#export` introduces no dependency.
+                if (s == LineSpecies::Export)
+                    return;
+            }
+            else if (s == LineSpecies::Import)
+                sort = DependencySort::Import;
+            else
+            {
+                skip_blank(cursor);
+                sort = gather_name(cursor, buffer) == u8"module" ? DependencySort::Module : DependencySort::Import;
+            }
+
+            skip_blank(cursor);
+            if (cursor.done())
+                return;
+            auto name = directive ? header_operand(cursor) : module_operand(cursor);
+            if (not name.empty())
+                deps.push_back({ sort, line, std::move(name) });
+        }
+
+        // Write a string as a JSON string literal.
+        void write_json_string(std::ostream& os, std::u8string_view s)
+        {
+            constexpr char hex[] = "0123456789abcdef";
+            os << '"';
+            for (auto c : s)
+            {
+                switch (c) {
+                case u8'"': os << "\\\""; break;
+                case u8'\\': os << "\\\\"; break;
+                case u8'\n': os << "\\n"; break;
+                case u8'\r': os << "\\r"; break;
+                case u8'\t': os << "\\t"; break;
+                default:
+                    if (c < 0x20)
+                        os << "\\u00" << hex[c >> 4] << hex[c & 0xF];
+                    else
+                        os << static_cast<char>(c);
+                    break;
+                }
+            }
+            os << '"';
+        }
+
+        // Write the names of the dependencies of a given sort as a JSON array.
+        void write_json_names(std::ostream& os, const std::vector<Dependency>& deps, DependencySort sort)
+        {
+            os << '[';
+            bool first = true;
+            for (auto& dep : deps)
+            {
+                if (dep.sort != sort)
+                    continue;
+                if (not first)
+                    os << ',';
+                write_json_string(os, dep.name);
+                first = false;
+            }
+            os << ']';
+        }
+
+        // Return a description of an exception raised while scanning a source file.
+        std::u8string describe(std::exception_ptr error)
+        {
+            try {
+                std::rethrow_exception(error);
+            }
+            catch (const AccessError&) {
+                return u8"cannot access file";
+            }
+            catch (const RegularFileError&) {
+                return u8"not a regular file";
+            }
+            catch (const FileMappingError&) {
+                return u8"cannot map file to memory";
+            }
+            catch (const std::exception& e) {
+                std::string_view what = e.what();
+                return { what.begin(), what.end() };
+            }
+            catch (...) {
+            }
+            return u8"unknown error";
+        }
+    }
+
+    std::vector<Dependency> dependencies(const SourceListing& listing)
+    {
+        std::vector<Dependency> deps;
+        for (auto x : listing.logical_lines())
+        {
+            const auto s = x.species();
+            if (s != LineSpecies::Include and s != LineSpecies::Import
+                and s != LineSpecies::Export and s != LineSpecies::Embed)
+                continue;
+            if (x.sort() == LineSort::Simple)
+            {
+                auto& line = listing.simple_line(x).line;
+                gather_dependency(LineCursor{listing.contents(line.isle, listing.line_depot())}, s, line.number, deps);
+            }
+            else
+            {
+                auto composite = listing.composite_line(x);
+                gather_dependency(SplicedCursor{listing.contents().data(), listing.line_depot(), composite}, s, composite.lines.front().number, deps);
+            }
+        }
+        return deps;
+    }
+
+    std::vector<DependencyRecord> scan_dependencies(std::span<const SystemPath> paths, unsigned threads)
+    {
+        std::vector<DependencyRecord> records(paths.size());
+        concurrently(paths.size(), threads, [&](std::size_t i) {
+            auto& record = records[i];
+            record.path = paths[i];
+            try {
+                record.dependencies = dependencies(SourceListing{paths[i]});
+            }
+            catch (...) {
+                record.error = std::current_exception();
+            }
+        });
+        return records;
+    }
+
+    void write_json_line(std::ostream& os, const DependencyRecord& record)
+    {
+        os << "{\"source\":";
+        write_json_string(os, std::filesystem::path{record.path}.u8string());
+        if (record.error)
+        {
+            os << ",\"error\":";
+            write_json_string(os, describe(record.error));
+        }
+        else
+        {
+            os << ",\"provides\":";
+            write_json_names(os, record.dependencies, DependencySort::Module);
+            os << ",\"imports\":";
+            write_json_names(os, record.dependencies, DependencySort::Import);
+            os << ",\"includes\":";
+            write_json_names(os, record.dependencies, DependencySort::Include);
+            os << ",\"embeds\":";
+            write_json_names(os, record.dependencies, DependencySort::Embed);
+        }
+        os << "}\n";
+    }
+}
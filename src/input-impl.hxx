@@ -0,0 +1,180 @@
+// -*- C++ -*-
+//
+// This file is part of The Pivot framework.
+// Written by Gabriel Dos Reis.
+// See LICENSE for copyright and license notices.
+//
+
+// Facilities shared by the translation units implementing the input library.
+
+#ifndef IPR_INPUT_IMPL_INCLUDED
+#define IPR_INPUT_IMPL_INCLUDED
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include "ipr/input"
+
+namespace ipr::input {
+    // Classes of characters, as bit flags of the entries of the character classification table.
+    namespace char_class {
+        constexpr std::uint8_t blank = 1 << 0;              // whitespace, other than line terminators
+        constexpr std::uint8_t narrow_alnum = 1 << 1;       // letter, digit, or `_`
+        constexpr std::uint8_t directive_initial = 1 << 2;  // first character of a standard directive
+    }
+
+    // Classification of code units, one entry per value.  Non-ASCII code units belong to no class.
+    constexpr auto char_classes = [] {
+        std::array<std::uint8_t, 256> table { };
+        for (char8_t c : std::u8string_view{u8" \t\v\f"})
+            table[c] |= char_class::blank;
+        for (char8_t c = u8'A'; c <= u8'Z'; ++c)
+            table[c] |= char_class::narrow_alnum;
+        for (char8_t c = u8'a'; c <= u8'z'; ++c)
+            table[c] |= char_class::narrow_alnum;
+        for (char8_t c = u8'0'; c <= u8'9'; ++c)
+            table[c] |= char_class::narrow_alnum;
+        table[u8'_'] |= char_class::narrow_alnum;
+        for (char8_t c : std::u8string_view{u8"deilpuw"})
+            table[c] |= char_class::directive_initial;
+        return table;
+    }();
+
+    static inline bool white_space(char8_t c)
+    {
+        return char_classes[c] & char_class::blank;
+    }
+
+    // Quick and simple predicate for constitutents of a narrow identifier.
+    inline bool narrow_letter_or_digit(char8_t c)
+    {
+        return char_classes[c] & char_class::narrow_alnum;
+    }
+
+    // Cursor over the characters of a simple logical line.
+    struct LineCursor {
+        LineCursor(SourceFile::View line) : ptr{line.data()}, end{line.data() + line.size()} { }
+        bool done() const { return ptr == end; }
+        char8_t operator*() const { return *ptr; }
+        const char8_t* where() const { return ptr; }
+        void advance() { ++ptr; }
+    private:
+        const char8_t* ptr;
+        const char8_t* end;
+    };
+
+    // Cursor over the characters of a composite logical line.  The physical lines are walked
+    // in sequence, directly in the source text, as if they were spliced together.
+    struct SplicedCursor {
+        SplicedCursor(const char8_t* text, const LineDepot& depot, CompositeLine composite)
+            : text{text}, depot{depot}, lines{composite.lines}
+        {
+            enter_line();
+        }
+        bool done() const { return ptr == end; }
+        char8_t operator*() const { return *ptr; }
+        const char8_t* where() const { return ptr; }
+        void advance()
+        {
+            if (++ptr == end)
+                enter_line();
+        }
+    private:
+        // Move to the next non-empty physical line, if any.
+        void enter_line()
+        {
+            while (not lines.empty() and lines.front().isle.length == 0)
+                lines = lines.subspan(1);
+            if (lines.empty())
+                return;
+            ptr = text + lines.front().isle.offset;
+            end = ptr + depot.length(lines.front().isle);
+            lines = lines.subspan(1);
+        }
+
+        const char8_t* text;
+        const LineDepot& depot;
+        std::span<const PhysicalLine> lines;
+        const char8_t* ptr { };
+        const char8_t* end { };
+    };
+
+    // Advance the argument bound to `cursor` past the next consecutive whitespace characters.
+    template<typename Cursor>
+    inline void skip_blank(Cursor& cursor)
+    {
+        while (not cursor.done() and white_space(*cursor))
+            cursor.advance();
+    }
+
+    // Gather in `buffer` the narrow identifier starting at the cursor, and return its spelling.
+    // Return an empty view if the identifier does not fit in the buffer.
+    // Note: An identifier may straddle physical lines; hence the gathering in a local buffer.
+    template<typename Cursor, std::size_t N>
+    std::u8string_view gather_name(Cursor& cursor, char8_t (&buffer)[N])
+    {
+        std::size_t length = 0;
+        for (; not cursor.done() and narrow_letter_or_digit(*cursor); cursor.advance())
+        {
+            if (length == N)
+                return { };
+            buffer[length++] = *cursor;
+        }
+        return { buffer, length };
+    }
+
+    // Apply `work` to each index in [0, count), on the given number of threads.  Zero means
+    // as many as the host supports.  The calling thread takes its share of the work.
+    template<typename F>
+    void concurrently(std::size_t count, unsigned threads, F work)
+    {
+        std::atomic<std::size_t> next { 0 };
+        const auto worker = [&] {
+            for (auto i = next++; i < count; i = next++)
+                work(i);
+        };
+        if (threads == 0)
+            threads = std::max(1u, std::thread::hardware_concurrency());
+        const auto helpers = std::min<std::size_t>(threads, count);
+        std::vector<std::jthread> pool;
+        if (helpers > 1)
+            pool.reserve(helpers - 1);
+        for (std::size_t i = 1; i < helpers; ++i)
+            pool.emplace_back(worker);
+        worker();
+    }
+
+    // Size of the blocks of storage in which a source set pools small files.
+    constexpr std::size_t pool_block_size = 1 << 20;
+
+    // Allocator of storage for small files, pooled in large blocks, for use by concurrent loaders.
+    struct BufferPool {
+        explicit BufferPool(std::vector<std::unique_ptr<char8_t[]>>& blocks) : blocks{blocks} { }
+
+        char8_t* allocate(std::size_t size)
+        {
+            std::lock_guard lock { mutex };
+            if (size > pool_block_size / 4)
+                return blocks.emplace_back(std::make_unique_for_overwrite<char8_t[]>(size)).get();
+            if (size > available)
+            {
+                cursor = blocks.emplace_back(std::make_unique_for_overwrite<char8_t[]>(pool_block_size)).get();
+                available = pool_block_size;
+            }
+            auto p = cursor;
+            cursor += size;
+            available -= size;
+            return p;
+        }
+
+    private:
+        std::vector<std::unique_ptr<char8_t[]>>& blocks;
+        std::mutex mutex;
+        char8_t* cursor = nullptr;
+        std::size_t available = 0;
+    };
+}
+
+#endif // IPR_INPUT_IMPL_INCLUDED
@@ -0,0 +1,262 @@
+//
+// This file is part of The Pivot framework.
+// Written by Gabriel Dos Reis.
+// See LICENSE for copright and license notices.
+//
+
+#ifdef _WIN32
+#  include <windows.h>
+#else
+#  include <sys/stat.h>
+#  include <sys/mman.h>
+#  include <fcntl.h>
+#  include <unistd.h>
+#endif
+
+#include <map>
+#include <mutex>
+#include <utility>
+#include "input-impl.hxx"
+
+namespace ipr::input {
+    namespace {
+#ifdef _WIN32
+        // Identity of a file, independently of the path used to designate it.
+        using FileKey = SystemPath;
+
+        FileKey file_key(const SystemPath& path)
+        {
+            return std::filesystem::weakly_canonical(path).native();
+        }
+#else
+        // Identity of a file, independently of the path used to designate it.
+        using FileKey = std::pair<dev_t, ino_t>;
+
+        // Helper type for automatically closing a file descriptor on scope exit.
+        struct FileDescriptor {
+            explicit FileDescriptor(int fd) : fd{fd} { }
+            FileDescriptor(const FileDescriptor&) = delete;
+            ~FileDescriptor()
+            {
+                if (fd >= 0)
+                    close(fd);
+            }
+            int fd;
+        };
+
+        // Read the entire contents of an open file into `buffer`.
+        void read_contents(const SystemPath& path, int fd, char8_t* buffer, std::size_t size)
+        {
+            while (size > 0)
+            {
+                auto n = read(fd, buffer, size);
+                if (n < 0 and errno == EINTR)
+                    continue;
+                if (n <= 0)
+                    throw AccessError{ path, n < 0 ? errno : EIO };
+                buffer += n;
+                size -= n;
+            }
+        }
+#endif
+    }
+
+    // Loader of the files designated by the paths of a source set, shared by the loading threads.
+    struct SourceSet::Loader {
+        Loader(const LoadOptions& options, std::vector<std::unique_ptr<char8_t[]>>& blocks)
+            : options{options}, pool{blocks}
+        { }
+
+        // Load the file designated by a path, unless it was already loaded through another
+        // path.  Return the index of the file in the sequence of loaded files.
+        std::size_t load(const SystemPath& path);
+
+        // Exception raised by the loading of the file of the given index, if any.
+        std::exception_ptr failure(std::size_t n) const { return loaded[n].error; }
+
+        // The loaded files, in order of their indices.
+        std::deque<SourceFile> take_files() &&;
+
+    private:
+        // Record a newly identified file, unless it is already known.  Return its index, and
+        // whether it is new.
+        std::pair<std::size_t, bool> enter(FileKey key)
+        {
+            std::lock_guard lock { mutex };
+            auto [place, fresh] = known.try_emplace(std::move(key), loaded.size());
+            if (fresh)
+                loaded.emplace_back();
+            return { place->second, fresh };
+        }
+
+        // Set the contents of a newly loaded file.  From then on, the loader owns them until
+        // they are taken, so that they are released should the construction of the set fail.
+        void define(std::size_t n, SourceFile::View v, SourceFile::Storage s)
+        {
+            std::lock_guard lock { mutex };
+            loaded[n].file.view = v;
+            loaded[n].file.storage = s;
+        }
+
+        // Read the contents of a newly identified file.
+        void read_file(std::size_t n, const SystemPath& path, int fd, std::size_t size);
+
+        struct Contents {
+            SourceFile file { SourceFile::View{ }, SourceFile::Storage::Borrowed };
+            std::exception_ptr error;       // set if the contents could not be read.
+        };
+
+        const LoadOptions& options;
+        BufferPool pool;
+        std::mutex mutex;
+        std::map<FileKey, std::size_t> known;
+        std::vector<Contents> loaded;
+    };
+
+    std::size_t SourceSet::Loader::load(const SystemPath& path)
+    {
+#ifdef _WIN32
+        auto [n, fresh] = enter(file_key(path));
+        if (fresh)
+        {
+            SourceFile file{path};
+            // Note: Ownership of the mapping is transferred to the source set.
+            define(n, std::exchange(file.view, { }), SourceFile::Storage::Mapped);
+        }
+        return n;
+#else
+        FileDescriptor file { open(path.c_str(), O_RDONLY | O_CLOEXEC) };
+        if (file.fd < 0)
+            throw AccessError{ path, errno };
+        struct stat s { };
+        if (fstat(file.fd, &s) < 0)
+            throw AccessError{ path, errno };
+        if (not S_ISREG(s.st_mode))
+            throw RegularFileError{ path };
+        auto [n, fresh] = enter({ s.st_dev, s.st_ino });
+        if (fresh and s.st_size != 0)
+        {
+            try {
+                read_file(n, path, file.fd, static_cast<std::size_t>(s.st_size));
+            }
+            catch (...) {
+                std::lock_guard lock { mutex };
+                loaded[n].error = std::current_exception();
+                throw;
+            }
+        }
+        return n;
+#endif
+    }
+
+#ifndef _WIN32
+    void SourceSet::Loader::read_file(std::size_t n, const SystemPath& path, int fd, std::size_t size)
+    {
+        if (size <= options.small_file_size)
+        {
+            auto buffer = pool.allocate(size);
+            read_contents(path, fd, buffer, size);
+            define(n, { buffer, size }, SourceFile::Storage::Borrowed);
+            return;
+        }
+
+        int flags = MAP_PRIVATE;
+#  ifdef MAP_POPULATE
+        if (options.populate)
+            flags |= MAP_POPULATE;
+#  endif
+        auto start = mmap(nullptr, size, PROT_READ, flags, fd, 0);
+        if (start == MAP_FAILED)
+            throw FileMappingError{ path, errno };
+        madvise(start, size, MADV_SEQUENTIAL);
+        define(n, { reinterpret_cast<const char8_t*>(start), size }, SourceFile::Storage::Mapped);
+    }
+#endif
+
+    std::deque<SourceFile> SourceSet::Loader::take_files() &&
+    {
+        std::deque<SourceFile> files;
+        for (auto& x : loaded)
+            files.push_back(std::move(x.file));
+        return files;
+    }
+
+    SourceSet::SourceSet(std::span<const SystemPath> paths, const LoadOptions& options)
+        : SourceSet{paths, options, { }}
+    { }
+
+    SourceSet::SourceSet(std::span<const SystemPath> paths, const LoadOptions& options, const LoadHandler& handler)
+        : slots(paths.size())
+    {
+        for (std::size_t i = 0; i < paths.size(); ++i)
+            slots[i].path = paths[i];
+        if (options.backend == LoadBackend::Ring and load_through_ring(handler))
+            return;
+
+        Loader loader { options, buffers };
+        concurrently(paths.size(), options.threads, [&](std::size_t i) {
+            auto& slot = slots[i];
+            try {
+                slot.file = loader.load(paths[i]);
+            }
+            catch (...) {
+                slot.error = std::current_exception();
+            }
+        });
+        // A path resolving to a file that failed to load through another path shares that failure.
+        for (auto& slot : slots)
+        {
+            if (not slot.error)
+                slot.error = loader.failure(slot.file);
+        }
+        files = std::move(loader).take_files();
+        count_files();
+        if (handler)
+        {
+            for (std::size_t i = 0; i < slots.size(); ++i)
+                handler(*this, i);
+        }
+    }
+
+    void SourceSet::count_files()
+    {
+        std::vector<bool> seen(files.size());
+        for (auto& slot : slots)
+        {
+            if (not slot.error and not seen[slot.file])
+            {
+                seen[slot.file] = true;
+                ++distinct;
+            }
+        }
+    }
+
+    const SourceFile& SourceSet::file(std::size_t n) const
+    {
+        if (slots[n].error)
+            std::rethrow_exception(slots[n].error);
+        return files[slots[n].file];
+    }
+
+    void SourceSet::prefetch(std::size_t n) const
+    {
+        if (slots[n].error)
+            return;
+        auto& f = files[slots[n].file];
+        if (f.storage != SourceFile::Storage::Mapped or f.view.empty())
+            return;
+#ifdef _WIN32
+        WIN32_MEMORY_RANGE_ENTRY range { const_cast<char8_t*>(f.view.data()), f.view.size() };
+        PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#else
+        madvise(const_cast<char8_t*>(f.view.data()), f.view.size(), MADV_WILLNEED);
+#endif
+    }
+
+    SourceListing SourceSet::listing(std::size_t n, const ListingOptions& options) const
+    {
+        prefetch(n);
+        auto& f = file(n);
+        return { slots[n].path, SourceFile{ f.view, SourceFile::Storage::Borrowed }, options };
+    }
+}
@@ -0,0 +1,450 @@
+//
+// This file is part of The Pivot framework.
+// Written by Gabriel Dos Reis.
+// See LICENSE for copright and license notices.
+//
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#  define IPR_INPUT_IO_URING
+#  include <linux/io_uring.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <sys/syscall.h>
+#  include <sys/sysmacros.h>
+#  include <fcntl.h>
+#  include <unistd.h>
+#endif
+
+#include <map>
+#include <system_error>
+#include <utility>
+#include "input-impl.hxx"
+
+namespace ipr::input {
+#ifdef IPR_INPUT_IO_URING
+    namespace {
+        // Minimal interface to an io_uring instance, through raw system calls.
+        struct Ring {
+            explicit Ring(unsigned entries)
+            {
+                fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+                if (fd < 0)
+                    return;
+                sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+                cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+                const bool single = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+                if (single)
+                    sq_size = cq_size = std::max(sq_size, cq_size);
+                sq_ring = mmap(nullptr, sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+                cq_ring = single ? sq_ring
+                    : mmap(nullptr, cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+                auto entries_start = mmap(nullptr, params.sq_entries * sizeof(io_uring_sqe), PROT_READ | PROT_WRITE,
+                                          MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+                if (sq_ring == MAP_FAILED or cq_ring == MAP_FAILED or entries_start == MAP_FAILED)
+                {
+                    if (entries_start != MAP_FAILED)
+                        munmap(entries_start, params.sq_entries * sizeof(io_uring_sqe));
+                    release();
+                    return;
+                }
+                sqes = static_cast<io_uring_sqe*>(entries_start);
+                auto sq = static_cast<char*>(sq_ring);
+                auto cq = static_cast<char*>(cq_ring);
+                sq_head = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+                sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+                sq_mask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+                sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+                cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+                cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+                cq_mask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+                cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+                local_tail = *sq_tail;
+            }
+
+            Ring(const Ring&) = delete;
+            ~Ring() { release(); }
+
+            bool valid() const { return fd >= 0; }
+
+            // This predicate holds if the host supports all the argument operations.
+            bool supports(std::initializer_list<unsigned> ops) const
+            {
+                constexpr unsigned count = 256;
+                alignas(io_uring_probe) std::byte storage[sizeof(io_uring_probe) + count * sizeof(io_uring_probe_op)] { };
+                auto probe = reinterpret_cast<io_uring_probe*>(storage);
+                if (syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, count) < 0)
+                    return false;
+                return std::ranges::all_of(ops, [probe](unsigned op) {
+                    return op <= probe->last_op and (probe->ops[op].flags & IO_URING_OP_SUPPORTED) != 0;
+                });
+            }
+
+            // Return a cleared submission queue entry, or null if the submission queue is full.
+            io_uring_sqe* next_entry()
+            {
+                const auto head = std::atomic_ref{*sq_head}.load(std::memory_order_acquire);
+                if (local_tail - head == params.sq_entries)
+                    return nullptr;
+                const auto n = local_tail & sq_mask;
+                sq_array[n] = n;
+                ++local_tail;
+                ++pending;
+                sqes[n] = { };
+                return &sqes[n];
+            }
+
+            // Submit the prepared entries, and wait for at least `wait` completions.
+            void submit(unsigned wait)
+            {
+                std::atomic_ref{*sq_tail}.store(local_tail, std::memory_order_release);
+                for (;;)
+                {
+                    auto n = syscall(__NR_io_uring_enter, fd, pending, wait, wait != 0 ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+                    if (n >= 0)
+                    {
+                        pending -= static_cast<unsigned>(n);
+                        return;
+                    }
+                    if (errno != EINTR and errno != EAGAIN and errno != EBUSY)
+                        throw std::system_error{ errno, std::generic_category(), "io_uring_enter" };
+                }
+            }
+
+            // Call `f` on each available completion.
+            template<typename F>
+            void reap(F f)
+            {
+                auto head = *cq_head;
+                const auto tail = std::atomic_ref{*cq_tail}.load(std::memory_order_acquire);
+                for (; head != tail; ++head)
+                {
+                    const auto cqe = cqes[head & cq_mask];
+                    std::atomic_ref{*cq_head}.store(head + 1, std::memory_order_release);
+                    f(cqe);
+                }
+            }
+
+        private:
+            void release()
+            {
+                if (sqes != nullptr)
+                    munmap(sqes, params.sq_entries * sizeof(io_uring_sqe));
+                if (cq_ring != MAP_FAILED and cq_ring != sq_ring)
+                    munmap(cq_ring, cq_size);
+                if (sq_ring != MAP_FAILED)
+                    munmap(sq_ring, sq_size);
+                if (fd >= 0)
+                    close(fd);
+                fd = -1;
+                sqes = nullptr;
+                sq_ring = cq_ring = MAP_FAILED;
+            }
+
+            int fd = -1;
+            io_uring_params params { };
+            void* sq_ring = MAP_FAILED;
+            void* cq_ring = MAP_FAILED;
+            std::size_t sq_size = 0;
+            std::size_t cq_size = 0;
+            io_uring_sqe* sqes = nullptr;
+            unsigned* sq_head = nullptr;
+            unsigned* sq_tail = nullptr;
+            unsigned* sq_array = nullptr;
+            unsigned sq_mask = 0;
+            unsigned* cq_head = nullptr;
+            unsigned* cq_tail = nullptr;
+            unsigned cq_mask = 0;
+            io_uring_cqe* cqes = nullptr;
+            unsigned local_tail = 0;        // tail of the submission queue, including unpublished entries.
+            unsigned pending = 0;           // number of entries prepared but not yet submitted.
+        };
+
+        // Number of paths being loaded at any time through a ring.
+        constexpr unsigned ring_window = 64;
+
+        // Largest number of bytes requested by a single read.
+        constexpr std::size_t ring_read_limit = 1 << 30;
+    }
+
+    // Loader of the files of a source set through an io_uring instance.  Each path goes through
+    // an `openat` request, then a `statx` request on the file it opened, then, for a file not
+    // already known, `read` requests into storage pooled by the source set.  The file queried is
+    // thus the file read, even if the path is renamed over in the meantime.
+    struct SourceSet::RingLoader {
+        RingLoader(SourceSet& set, const LoadHandler& handler)
+            : set{set}, handler{handler}, pool{set.buffers}, ring{4 * ring_window}
+        { }
+
+        RingLoader(const RingLoader&) = delete;
+
+        // The files of requests still in flight, e.g. when a submission fails, are closed.
+        ~RingLoader()
+        {
+            for (auto& req : requests)
+                close_file(req);
+        }
+
+        // This predicate holds if loading through a ring is supported by the host.
+        bool available() const
+        {
+            return ring.valid() and ring.supports({ IORING_OP_OPENAT, IORING_OP_STATX, IORING_OP_READ });
+        }
+
+        void run();
+
+    private:
+        // Operations requested on behalf of a path.
+        enum class Operation : std::uint64_t { Open, Stat, Read };
+
+        // State of the loading of a path, occupying one place in the window of paths in flight.
+        struct Request {
+            std::size_t path;               // index of the path in the source set.
+            std::size_t file;               // index of the file, once identified.
+            int fd = -1;
+            int error = 0;                  // first error reported by the host OS, if any.
+            std::size_t done = 0;           // number of bytes read so far.
+            struct statx status;
+        };
+
+        // Outcome of the loading of a file, and the paths awaiting it.
+        struct FileState {
+            bool complete = false;
+            std::exception_ptr error;
+            std::vector<std::size_t> waiters;
+        };
+
+        io_uring_sqe* entry()
+        {
+            auto sqe = ring.next_entry();
+            while (sqe == nullptr)
+            {
+                ring.submit(0);
+                sqe = ring.next_entry();
+            }
+            return sqe;
+        }
+
+        static std::uint64_t tag(std::size_t r, Operation op) { return r << 2 | std::to_underlying(op); }
+
+        // Close the file of a request, if open.
+        static void close_file(Request& req)
+        {
+            if (req.fd >= 0)
+                close(req.fd);
+            req.fd = -1;
+        }
+
+        void start(std::size_t r, std::size_t path);
+        void stat(std::size_t r);
+        void read(std::size_t r);
+        void opened(std::size_t r);
+        void complete(const io_uring_cqe&);
+        void complete_file(std::size_t r, std::exception_ptr);
+        void finish(std::size_t path, std::exception_ptr);
+
+        SourceSet& set;
+        const LoadHandler& handler;
+        BufferPool pool;
+        Ring ring;
+        Request requests[ring_window];
+        std::vector<std::size_t> free_requests;
+        std::map<std::pair<dev_t, std::uint64_t>, std::size_t> known;
+        std::vector<FileState> states;
+        std::size_t finished = 0;           // number of paths done with.
+        std::exception_ptr failure;         // first exception raised by the handler, if any.
+    };
+
+    void SourceSet::RingLoader::run()
+    {
+        const auto count = set.slots.size();
+        for (std::size_t r = ring_window; r-- > 0; )
+            free_requests.push_back(r);
+        std::size_t next = 0;
+        while (finished < count)
+        {
+            for (; next < count and not free_requests.empty(); ++next)
+            {
+                start(free_requests.back(), next);
+                free_requests.pop_back();
+            }
+            ring.submit(1);
+            ring.reap([this](const io_uring_cqe& cqe) { complete(cqe); });
+        }
+        // Note: An exception raised by the handler is held until no request is in flight.
+        if (failure)
+            std::rethrow_exception(failure);
+    }
+
+    void SourceSet::RingLoader::start(std::size_t r, std::size_t path)
+    {
+        auto& req = requests[r];
+        req = { };
+        req.path = path;
+        auto sqe = entry();
+        sqe->opcode = IORING_OP_OPENAT;
+        sqe->fd = AT_FDCWD;
+        sqe->addr = reinterpret_cast<std::uintptr_t>(set.slots[path].path.c_str());
+        sqe->open_flags = O_RDONLY | O_CLOEXEC;
+        sqe->user_data = tag(r, Operation::Open);
+    }
+
+    void SourceSet::RingLoader::stat(std::size_t r)
+    {
+        static constexpr char empty[] = "";
+        auto& req = requests[r];
+        auto sqe = entry();
+        sqe->opcode = IORING_OP_STATX;
+        sqe->fd = req.fd;
+        sqe->addr = reinterpret_cast<std::uintptr_t>(empty);
+        sqe->statx_flags = AT_EMPTY_PATH;
+        sqe->len = STATX_TYPE | STATX_SIZE | STATX_INO;
+        sqe->off = reinterpret_cast<std::uintptr_t>(&req.status);
+        sqe->user_data = tag(r, Operation::Stat);
+    }
+
+    void SourceSet::RingLoader::read(std::size_t r)
+    {
+        auto& req = requests[r];
+        auto view = set.files[req.file].view;
+        auto sqe = entry();
+        sqe->opcode = IORING_OP_READ;
+        sqe->fd = req.fd;
+        sqe->addr = reinterpret_cast<std::uintptr_t>(view.data() + req.done);
+        sqe->len = static_cast<std::uint32_t>(std::min(view.size() - req.done, ring_read_limit));
+        sqe->off = req.done;
+        sqe->user_data = tag(r, Operation::Read);
+    }
+
+    void SourceSet::RingLoader::complete(const io_uring_cqe& cqe)
+    {
+        const auto r = static_cast<std::size_t>(cqe.user_data >> 2);
+        auto& req = requests[r];
+        switch (static_cast<Operation>(cqe.user_data & 3))
+        {
+        case Operation::Open:
+            if (cqe.res < 0)
+            {
+                req.error = -cqe.res;
+                opened(r);
+            }
+            else
+            {
+                req.fd = cqe.res;
+                stat(r);
+            }
+            break;
+
+        case Operation::Stat:
+            if (cqe.res < 0)
+                req.error = -cqe.res;
+            opened(r);
+            break;
+
+        case Operation::Read:
+        {
+            auto& file = set.files[req.file];
+            if (cqe.res == -EINTR or cqe.res == -EAGAIN)
+                read(r);
+            else if (cqe.res < 0)
+                complete_file(r, std::make_exception_ptr(AccessError{ set.slots[req.path].path, -cqe.res }));
+            else if (cqe.res == 0)
+            {
+                // The file shrank since its size was queried; retain what was read.
+                file.view = file.view.first(req.done);
+                complete_file(r, nullptr);
+            }
+            else if ((req.done += cqe.res) < file.view.size())
+                read(r);
+            else
+                complete_file(r, nullptr);
+            break;
+        }
+        }
+    }
+
+    void SourceSet::RingLoader::opened(std::size_t r)
+    {
+        auto& req = requests[r];
+        auto& slot = set.slots[req.path];
+        const auto path = req.path;
+        const auto release = [&](std::exception_ptr error) {
+            close_file(req);
+            free_requests.push_back(r);
+            finish(path, error);
+        };
+
+        if (req.error != 0)
+            return release(std::make_exception_ptr(AccessError{ slot.path, req.error }));
+        if (not S_ISREG(req.status.stx_mode))
+            return release(std::make_exception_ptr(RegularFileError{ slot.path }));
+
+        const std::pair key { makedev(req.status.stx_dev_major, req.status.stx_dev_minor), req.status.stx_ino };
+        auto [place, fresh] = known.try_emplace(key, set.files.size());
+        slot.file = place->second;
+        if (not fresh)
+        {
+            auto& state = states[slot.file];
+            if (state.complete)
+                return release(state.error);
+            close_file(req);
+            free_requests.push_back(r);
+            state.waiters.push_back(path);
+            return;
+        }
+
+        req.file = slot.file;
+        states.emplace_back();
+        const auto size = static_cast<std::size_t>(req.status.stx_size);
+        auto& file = set.files.emplace_back(SourceFile{ SourceFile::View{ }, SourceFile::Storage::Borrowed });
+        if (size == 0)
+            return complete_file(r, nullptr);
+        file.view = { pool.allocate(size), size };
+        read(r);
+    }
+
+    void SourceSet::RingLoader::complete_file(std::size_t r, std::exception_ptr error)
+    {
+        auto& req = requests[r];
+        close_file(req);
+        auto& state = states[req.file];
+        state.complete = true;
+        state.error = error;
+        const auto path = req.path;
+        const auto waiters = std::move(state.waiters);
+        free_requests.push_back(r);
+        finish(path, error);
+        for (auto w : waiters)
+            finish(w, error);
+    }
+
+    void SourceSet::RingLoader::finish(std::size_t path, std::exception_ptr error)
+    {
+        set.slots[path].error = error;
+        ++finished;
+        if (not handler)
+            return;
+        try {
+            handler(set, path);
+        }
+        catch (...) {
+            if (not failure)
+                failure = std::current_exception();
+        }
+    }
+    bool SourceSet::load_through_ring(const LoadHandler& handler)
+    {
+        RingLoader ring { *this, handler };
+        if (not ring.available())
+            return false;
+        mechanism = LoadBackend::Ring;
+        ring.run();
+        count_files();
+        return true;
+    }
+#else
+    bool SourceSet::load_through_ring(const LoadHandler&)
+    {
+        return false;
+    }
+#endif
+}
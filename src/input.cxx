@@ -13,12 +13,35 @@
 #  include <unistd.h>
 #endif
 
+#if defined(__x86_64__) || defined(_M_X64)
+#  define IPR_INPUT_X86
+#  include <immintrin.h>
+#  ifdef _MSC_VER
+#    include <intrin.h>
+#    define IPR_TARGET_AVX2
+#  else
+#    define IPR_TARGET_AVX2 __attribute__((target("avx2")))
+#  endif
+#endif
+
 #include <assert.h>
+#include <array>
+#include <bit>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <limits>
+#include <optional>
+#include <stdexcept>
+#include <system_error>
 #include <utility>
 #include <string_view>
 #include <algorithm>
-#include "ipr/input"
+#include <future>
+#include <thread>
+#include "input-impl.hxx"
 
 namespace ipr::input {
     namespace {
@@ -131,14 +154,23 @@ namespace ipr::input {
 #endif
     }
 
-    SourceFile::SourceFile(SourceFile&& src) noexcept : view{src.view}
+    SourceFile::SourceFile(View text) : view{text}, storage{Storage::Borrowed}
+    { }
+
+    SourceFile::SourceFile(std::unique_ptr<char8_t[]> text, std::size_t size)
+        : view{text.release(), size}, storage{Storage::Owned}
+    { }
+
+    SourceFile::SourceFile(SourceFile&& src) noexcept : view{src.view}, storage{src.storage}
     {
         src.view = { };
     }
 
     SourceFile::~SourceFile()
     {
-        if (not view.empty())
+        if (storage == Storage::Owned)
+            delete[] view.data();
+        else if (storage == Storage::Mapped and not view.empty())
         {
 #ifdef _WIN32
             UnmapViewOfFile(view.data());
@@ -148,11 +180,6 @@ namespace ipr::input {
         }
     }
 
-    SourceFile::View SourceFile::contents(Isle m) const noexcept
-    {
-        assert(m.length < view.size());
-        return { view.data() + m.offset, m.length };
-    }
 
     // All code fragments directly indexable must have offsets and extents less than these limits.
     constexpr auto max_offset = std::uint64_t{1} << 47;
@@ -162,46 +189,536 @@ namespace ipr::input {
     constexpr char8_t carriage_return = 0x0D;    // '\r';
     constexpr char8_t line_feed = 0x0A;          // '\n';
 
-    static inline bool white_space(char8_t c)
-    {
-        switch (c)
+    namespace {
+        // Extent of a physical line: number of bytes before its terminator, and number
+        // of leading whitespace characters.
+        struct LineExtent {
+            std::uint64_t length;
+            std::uint64_t indent;
+        };
+
+        // Signature of the kernels scanning a physical line starting at the first argument, and
+        // extending at most over the number of bytes designated by the second argument.
+        using LineScanner = LineExtent (*)(const char8_t*, std::uint64_t) noexcept;
+
+        // Finish the scan of a physical line, one byte at a time, from the position `idx`.
+        // The argument bound to `indent` is meaningful only if `idx` is still within the leading blanks.
+        inline LineExtent finish_line_scan(const char8_t* ptr, std::uint64_t idx, std::uint64_t limit, bool in_indent) noexcept
         {
-        case u' ': case u8'\t': case u8'\v': case u8'\f':
-            return true;
-        default:
-            return false;
+            auto indent = idx;
+            if (in_indent)
+            {
+                while (idx < limit and white_space(ptr[idx]))
+                    ++idx;
+                indent = idx;
+            }
+            while (idx < limit and ptr[idx] != carriage_return and ptr[idx] != line_feed)
+                ++idx;
+            return { idx, indent };
+        }
+
+        // Portable scanner.  Look for line terminators a machine word at a time, relying on the
+        // classic zero-byte detection bit trick.  The leading whitespace characters are skipped
+        // one byte at a time, as indentation tends to be short.
+        LineExtent scan_line_scalar(const char8_t* ptr, std::uint64_t limit) noexcept
+        {
+            std::uint64_t idx = 0;
+            while (idx < limit and white_space(ptr[idx]))
+                ++idx;
+            const auto indent = idx;
+            if constexpr (std::endian::native == std::endian::little)
+            {
+                constexpr auto ones = ~std::uint64_t{} / 0xFF;          // 0x0101...01
+                constexpr auto highs = ones << 7;                       // 0x8080...80
+                const auto zero_byte = [](std::uint64_t x) { return (x - ones) & ~x & highs; };
+                for (; idx + sizeof(std::uint64_t) <= limit; idx += sizeof(std::uint64_t))
+                {
+                    std::uint64_t word;
+                    std::memcpy(&word, ptr + idx, sizeof word);
+                    // Note: The lowest flagged byte is exact; borrows only affect higher bytes.
+                    if (auto hits = zero_byte(word ^ (ones * carriage_return)) | zero_byte(word ^ (ones * line_feed)))
+                        return { idx + std::countr_zero(hits) / 8, indent };
+                }
+            }
+            return finish_line_scan(ptr, idx, limit, false);
+        }
+
+        // Signature of the kernels counting the UTF-8 code points of a sequence of bytes, i.e.
+        // the bytes that are not continuation bytes (of the form 0b10xxxxxx).
+        using CodePointCounter = std::uint64_t (*)(const char8_t*, std::uint64_t) noexcept;
+
+        // Portable counter, a machine word at a time.
+        std::uint64_t count_code_points_scalar(const char8_t* ptr, std::uint64_t size) noexcept
+        {
+            constexpr auto highs = ~std::uint64_t{} / 0xFF << 7;        // 0x8080...80
+            std::uint64_t continuations = 0;
+            std::uint64_t idx = 0;
+            for (; idx + sizeof(std::uint64_t) <= size; idx += sizeof(std::uint64_t))
+            {
+                std::uint64_t word;
+                std::memcpy(&word, ptr + idx, sizeof word);
+                // A continuation byte has its top bit set, and the next bit clear.
+                continuations += std::popcount(word & ~(word << 1) & highs);
+            }
+            for (; idx < size; ++idx)
+                continuations += (ptr[idx] & 0xC0) == 0x80;
+            return size - continuations;
+        }
+
+        // Signature of the kernels validating UTF-8 text.  They return the offset of the first byte
+        // of the first ill-formed code unit sequence, or the size of the text if it is well-formed.
+        using Utf8Validator = std::uint64_t (*)(const char8_t*, std::uint64_t) noexcept;
+
+        // Return the length of the well-formed sequence starting with the non-ASCII byte at `idx`,
+        // or 0 if that sequence is ill-formed.  See Table 3-7 of the Unicode Standard.
+        inline std::uint64_t utf8_sequence_length(const char8_t* ptr, std::uint64_t idx, std::uint64_t size) noexcept
+        {
+            const auto continuation = [&](std::uint64_t i, char8_t low = 0x80, char8_t high = 0xBF) {
+                return i < size and ptr[i] >= low and ptr[i] <= high;
+            };
+            const auto c = ptr[idx];
+            if (c < 0xC2)
+                return 0;
+            else if (c < 0xE0)
+                return continuation(idx + 1) ? 2 : 0;
+            else if (c < 0xF0)
+                return continuation(idx + 1, c == 0xE0 ? 0xA0 : 0x80, c == 0xED ? 0x9F : 0xBF)
+                    and continuation(idx + 2) ? 3 : 0;
+            else if (c < 0xF5)
+                return continuation(idx + 1, c == 0xF0 ? 0x90 : 0x80, c == 0xF4 ? 0x8F : 0xBF)
+                    and continuation(idx + 2) and continuation(idx + 3) ? 4 : 0;
+            return 0;
+        }
+
+        // Portable validator.  Runs of ASCII characters are skipped a machine word at a time.
+        std::uint64_t validate_utf8_scalar(const char8_t* ptr, std::uint64_t size) noexcept
+        {
+            constexpr auto highs = ~std::uint64_t{} / 0xFF << 7;        // 0x8080...80
+            const auto ascii_word = [ptr](std::uint64_t idx) {
+                std::uint64_t word;
+                std::memcpy(&word, ptr + idx, sizeof word);
+                return (word & highs) == 0;
+            };
+            for (std::uint64_t idx = 0; idx < size; )
+            {
+                if (ptr[idx] < 0x80)
+                {
+                    for (++idx; idx + sizeof(std::uint64_t) <= size and ascii_word(idx); idx += sizeof(std::uint64_t))
+                        ;
+                }
+                else if (auto n = utf8_sequence_length(ptr, idx, size))
+                    idx += n;
+                else
+                    return idx;
+            }
+            return size;
+        }
+
+#ifdef IPR_INPUT_X86
+        // Scanner using 16-byte vectors, available on all x86-64 processors.
+        LineExtent scan_line_sse2(const char8_t* ptr, std::uint64_t limit) noexcept
+        {
+            const auto space = _mm_set1_epi8(' ');
+            const auto tab = _mm_set1_epi8('\t');
+            const auto vtab = _mm_set1_epi8('\v');
+            const auto feed = _mm_set1_epi8('\f');
+            const auto cr = _mm_set1_epi8(carriage_return);
+            const auto lf = _mm_set1_epi8(line_feed);
+            constexpr std::uint64_t width = sizeof(__m128i);
+
+            std::uint64_t idx = 0;
+            for (; idx + width <= limit; idx += width)
+            {
+                const auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ptr + idx));
+                const auto blanks = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, space), _mm_cmpeq_epi8(v, tab)),
+                                                 _mm_or_si128(_mm_cmpeq_epi8(v, vtab), _mm_cmpeq_epi8(v, feed)));
+                if (auto mask = ~static_cast<unsigned>(_mm_movemask_epi8(blanks)) & 0xFFFF)
+                {
+                    idx += std::countr_zero(mask);
+                    break;
+                }
+            }
+            if (idx + width > limit)
+                return finish_line_scan(ptr, idx, limit, true);
+
+            const auto indent = idx;
+            for (; idx + width <= limit; idx += width)
+            {
+                const auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ptr + idx));
+                const auto ends = _mm_or_si128(_mm_cmpeq_epi8(v, cr), _mm_cmpeq_epi8(v, lf));
+                if (auto mask = static_cast<unsigned>(_mm_movemask_epi8(ends)))
+                    return { idx + std::countr_zero(mask), indent };
+            }
+            auto extent = finish_line_scan(ptr, idx, limit, false);
+            return { extent.length, indent };
+        }
+
+        // Counter using 16-byte vectors.  As signed bytes, continuation bytes are those less than -64.
+        std::uint64_t count_code_points_sse2(const char8_t* ptr, std::uint64_t size) noexcept
+        {
+            const auto bound = _mm_set1_epi8(-64);
+            constexpr std::uint64_t width = sizeof(__m128i);
+            std::uint64_t continuations = 0;
+            std::uint64_t idx = 0;
+            for (; idx + width <= size; idx += width)
+            {
+                const auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ptr + idx));
+                continuations += std::popcount(static_cast<unsigned>(_mm_movemask_epi8(_mm_cmplt_epi8(v, bound))));
+            }
+            return idx - continuations + count_code_points_scalar(ptr + idx, size - idx);
+        }
+
+        // Validator skipping runs of ASCII characters 16 bytes at a time.  SSE2 lacks the byte
+        // shuffles needed to validate multi-byte sequences in vectors; those are checked one by one.
+        std::uint64_t validate_utf8_sse2(const char8_t* ptr, std::uint64_t size) noexcept
+        {
+            constexpr std::uint64_t width = sizeof(__m128i);
+            const auto ascii_block = [ptr](std::uint64_t idx) {
+                return _mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(ptr + idx))) == 0;
+            };
+            for (std::uint64_t idx = 0; idx < size; )
+            {
+                if (ptr[idx] < 0x80)
+                {
+                    for (++idx; idx + width <= size and ascii_block(idx); idx += width)
+                        ;
+                }
+                else if (auto n = utf8_sequence_length(ptr, idx, size))
+                    idx += n;
+                else
+                    return idx;
+            }
+            return size;
+        }
+
+        // Scanner using 32-byte vectors, for processors supporting AVX2.
+        IPR_TARGET_AVX2 LineExtent scan_line_avx2(const char8_t* ptr, std::uint64_t limit) noexcept
+        {
+            const auto space = _mm256_set1_epi8(' ');
+            const auto tab = _mm256_set1_epi8('\t');
+            const auto vtab = _mm256_set1_epi8('\v');
+            const auto feed = _mm256_set1_epi8('\f');
+            const auto cr = _mm256_set1_epi8(carriage_return);
+            const auto lf = _mm256_set1_epi8(line_feed);
+            constexpr std::uint64_t width = sizeof(__m256i);
+
+            std::uint64_t idx = 0;
+            for (; idx + width <= limit; idx += width)
+            {
+                const auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ptr + idx));
+                const auto blanks = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, space), _mm256_cmpeq_epi8(v, tab)),
+                                                    _mm256_or_si256(_mm256_cmpeq_epi8(v, vtab), _mm256_cmpeq_epi8(v, feed)));
+                if (auto mask = ~static_cast<std::uint32_t>(_mm256_movemask_epi8(blanks)))
+                {
+                    idx += std::countr_zero(mask);
+                    break;
+                }
+            }
+            if (idx + width > limit)
+            {
+                auto extent = scan_line_sse2(ptr + idx, limit - idx);
+                return { idx + extent.length, idx + extent.indent };
+            }
+
+            const auto indent = idx;
+            for (; idx + width <= limit; idx += width)
+            {
+                const auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ptr + idx));
+                const auto ends = _mm256_or_si256(_mm256_cmpeq_epi8(v, cr), _mm256_cmpeq_epi8(v, lf));
+                if (auto mask = static_cast<std::uint32_t>(_mm256_movemask_epi8(ends)))
+                    return { idx + std::countr_zero(mask), indent };
+            }
+            auto extent = finish_line_scan(ptr, idx, limit, false);
+            return { extent.length, indent };
+        }
+
+        // Counter using 32-byte vectors.
+        IPR_TARGET_AVX2 std::uint64_t count_code_points_avx2(const char8_t* ptr, std::uint64_t size) noexcept
+        {
+            const auto bound = _mm256_set1_epi8(-64);
+            constexpr std::uint64_t width = sizeof(__m256i);
+            std::uint64_t continuations = 0;
+            std::uint64_t idx = 0;
+            for (; idx + width <= size; idx += width)
+            {
+                const auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ptr + idx));
+                continuations += std::popcount(static_cast<std::uint32_t>(_mm256_movemask_epi8(_mm256_cmpgt_epi8(bound, v))));
+            }
+            return idx - continuations + count_code_points_sse2(ptr + idx, size - idx);
+        }
+
+        // Error flags of the classification of pairs of consecutive bytes by the lookup validator.
+        namespace utf8 {
+            constexpr std::uint8_t too_short = 1 << 0;          // 11______ 0_______, or 11______ 11______
+            constexpr std::uint8_t too_long = 1 << 1;           // 0_______ 10______
+            constexpr std::uint8_t overlong_3 = 1 << 2;         // 11100000 100_____
+            constexpr std::uint8_t too_large = 1 << 3;          // 11110100 1001____, 11110100 101_____, 11110101+ ________
+            constexpr std::uint8_t surrogate = 1 << 4;          // 11101101 101_____
+            constexpr std::uint8_t overlong_2 = 1 << 5;         // 1100000_ 10______
+            constexpr std::uint8_t too_large_1000 = 1 << 6;     // 11110101+ 1000____
+            constexpr std::uint8_t overlong_4 = 1 << 6;         // 11110000 1000____
+            constexpr std::uint8_t two_continuations = 1 << 7;  // 10______ 10______
+            constexpr std::uint8_t carry = too_short | too_long | two_continuations;
+        }
+
+        // Return a vector holding the 16-entry table `x` in each of its lanes.
+        template<typename... T>
+        IPR_TARGET_AVX2 inline __m256i lookup_table(T... x) noexcept
+        {
+            static_assert(sizeof...(T) == 16);
+            return _mm256_broadcastsi128_si256(_mm_setr_epi8(static_cast<char>(x)...));
+        }
+
+        IPR_TARGET_AVX2 inline __m256i high_nibble(__m256i v) noexcept
+        {
+            return _mm256_and_si256(_mm256_srli_epi16(v, 4), _mm256_set1_epi8(0x0F));
+        }
+
+        // Return the error flags of a 32-byte block of input, given the block preceding it.
+        IPR_TARGET_AVX2 inline __m256i utf8_block_errors(__m256i input, __m256i previous) noexcept
+        {
+            using namespace utf8;
+            const auto nibble = _mm256_set1_epi8(0x0F);
+
+            // The input shifted by 1, 2, and 3 bytes, bringing in the last bytes of the previous block.
+            const auto carried = _mm256_permute2x128_si256(previous, input, 0x21);
+            const auto prev1 = _mm256_alignr_epi8(input, carried, 15);
+            const auto prev2 = _mm256_alignr_epi8(input, carried, 14);
+            const auto prev3 = _mm256_alignr_epi8(input, carried, 13);
+
+            const auto byte_1_high = _mm256_shuffle_epi8(lookup_table(
+                too_long, too_long, too_long, too_long, too_long, too_long, too_long, too_long,
+                two_continuations, two_continuations, two_continuations, two_continuations,
+                too_short | overlong_2,
+                too_short,
+                too_short | overlong_3 | surrogate,
+                too_short | too_large | too_large_1000 | overlong_4), high_nibble(prev1));
+            const auto byte_1_low = _mm256_shuffle_epi8(lookup_table(
+                carry | overlong_3 | overlong_2 | overlong_4,
+                carry | overlong_2,
+                carry, carry,
+                carry | too_large,
+                carry | too_large | too_large_1000, carry | too_large | too_large_1000, carry | too_large | too_large_1000,
+                carry | too_large | too_large_1000, carry | too_large | too_large_1000, carry | too_large | too_large_1000,
+                carry | too_large | too_large_1000, carry | too_large | too_large_1000,
+                carry | too_large | too_large_1000 | surrogate,
+                carry | too_large | too_large_1000, carry | too_large | too_large_1000), _mm256_and_si256(prev1, nibble));
+            const auto byte_2_high = _mm256_shuffle_epi8(lookup_table(
+                too_short, too_short, too_short, too_short, too_short, too_short, too_short, too_short,
+                too_long | overlong_2 | two_continuations | overlong_3 | too_large_1000 | overlong_4,
+                too_long | overlong_2 | two_continuations | overlong_3 | too_large,
+                too_long | overlong_2 | two_continuations | surrogate | too_large,
+                too_long | overlong_2 | two_continuations | surrogate | too_large,
+                too_short, too_short, too_short, too_short), high_nibble(input));
+            const auto special_cases = _mm256_and_si256(_mm256_and_si256(byte_1_high, byte_1_low), byte_2_high);
+
+            // Third and fourth bytes of 3- and 4-byte sequences must be continuations; so flagged
+            // as two consecutive continuations, they are not errors.
+            const auto third = _mm256_subs_epu8(prev2, _mm256_set1_epi8(static_cast<char>(0xE0 - 0x80)));
+            const auto fourth = _mm256_subs_epu8(prev3, _mm256_set1_epi8(static_cast<char>(0xF0 - 0x80)));
+            const auto must_continue = _mm256_and_si256(_mm256_or_si256(third, fourth), _mm256_set1_epi8(static_cast<char>(0x80)));
+            return _mm256_xor_si256(must_continue, special_cases);
+        }
+
+        // Validator using 32-byte vectors, after the lookup algorithm of J. Keiser and D. Lemire,
+        // "Validating UTF-8 In Less Than One Instruction Per Byte", Software: Practice and Experience
+        // 51(5), 2021.  The position of an error is determined by the scalar validator.
+        IPR_TARGET_AVX2 std::uint64_t validate_utf8_avx2(const char8_t* ptr, std::uint64_t size) noexcept
+        {
+            constexpr std::uint64_t width = sizeof(__m256i);
+            // Bytes beyond which the last bytes of a block start an incomplete sequence.
+            const auto incomplete_bound = _mm256_setr_epi8(
+                -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                static_cast<char>(0xF0 - 1), static_cast<char>(0xE0 - 1), static_cast<char>(0xC0 - 1));
+            auto error = _mm256_setzero_si256();
+            auto previous = _mm256_setzero_si256();
+            auto incomplete = _mm256_setzero_si256();
+            // The last, partial, block is padded with ASCII characters.
+            alignas(__m256i) char8_t tail[width] { };
+            for (std::uint64_t idx = 0; idx < size; idx += width)
+            {
+                const char8_t* block = ptr + idx;
+                if (size - idx < width)
+                    block = static_cast<const char8_t*>(std::memcpy(tail, block, size - idx));
+                const auto input = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block));
+                if (_mm256_movemask_epi8(input) == 0)
+                {
+                    error = _mm256_or_si256(error, incomplete);
+                    incomplete = _mm256_setzero_si256();
+                }
+                else
+                {
+                    error = _mm256_or_si256(error, utf8_block_errors(input, previous));
+                    incomplete = _mm256_subs_epu8(input, incomplete_bound);
+                }
+                previous = input;
+            }
+            error = _mm256_or_si256(error, incomplete);
+            if (_mm256_testz_si256(error, error))
+                return size;
+            return validate_utf8_scalar(ptr, size);
+        }
+
+        // This predicate holds if the host processor and operating system support AVX2.
+        bool avx2_supported() noexcept
+        {
+#  ifdef _MSC_VER
+            int info[4] { };
+            __cpuid(info, 0);
+            if (info[0] < 7)
+                return false;
+            __cpuid(info, 1);
+            constexpr int osxsave = 1 << 27;
+            constexpr int avx = 1 << 28;
+            if ((info[2] & osxsave) == 0 or (info[2] & avx) == 0)
+                return false;
+            // The OS must save and restore the XMM and YMM registers.
+            if ((_xgetbv(0) & 0x6) != 0x6)
+                return false;
+            __cpuidex(info, 7, 0);
+            return (info[1] & (1 << 5)) != 0;
+#  else
+            // The kernel is selected during static initialization, possibly before the runtime
+            // has initialized the processor model queried by __builtin_cpu_supports.
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx2");
+#  endif
+        }
+#endif // IPR_INPUT_X86
+
+        ScanKernel best_scan_kernel() noexcept
+        {
+#ifdef IPR_INPUT_X86
+            return avx2_supported() ? ScanKernel::AVX2 : ScanKernel::SSE2;
+#else
+            return ScanKernel::Scalar;
+#endif
+        }
+
+        LineScanner scanner_for(ScanKernel k) noexcept
+        {
+            switch (k)
+            {
+#ifdef IPR_INPUT_X86
+            case ScanKernel::AVX2:
+                return scan_line_avx2;
+            case ScanKernel::SSE2:
+                return scan_line_sse2;
+#endif
+            default:
+                return scan_line_scalar;
+            }
+        }
+
+        CodePointCounter counter_for(ScanKernel k) noexcept
+        {
+            switch (k)
+            {
+#ifdef IPR_INPUT_X86
+            case ScanKernel::AVX2:
+                return count_code_points_avx2;
+            case ScanKernel::SSE2:
+                return count_code_points_sse2;
+#endif
+            default:
+                return count_code_points_scalar;
+            }
+        }
+
+        Utf8Validator validator_for(ScanKernel k) noexcept
+        {
+            switch (k)
+            {
+#ifdef IPR_INPUT_X86
+            case ScanKernel::AVX2:
+                return validate_utf8_avx2;
+            case ScanKernel::SSE2:
+                return validate_utf8_sse2;
+#endif
+            default:
+                return validate_utf8_scalar;
+            }
         }
+
+        // The kernel in use for scanning source text, and its implementations.
+        ScanKernel line_scan_kernel = best_scan_kernel();
+        LineScanner line_scanner = scanner_for(line_scan_kernel);
+        CodePointCounter code_point_counter = counter_for(line_scan_kernel);
+        Utf8Validator utf8_validator = validator_for(line_scan_kernel);
+    }
+
+    ScanKernel scan_kernel() noexcept
+    {
+        return line_scan_kernel;
+    }
+
+    ScanKernel use_scan_kernel(ScanKernel k) noexcept
+    {
+        line_scan_kernel = std::min(k, best_scan_kernel());
+        line_scanner = scanner_for(line_scan_kernel);
+        code_point_counter = counter_for(line_scan_kernel);
+        utf8_validator = validator_for(line_scan_kernel);
+        return line_scan_kernel;
+    }
+
+    std::uint64_t first_invalid_utf8(std::span<const char8_t> text) noexcept
+    {
+        return utf8_validator(text.data(), text.size());
     }
 
     void SourceFile::LineRange::next_line() noexcept
     {
-        const auto offset = static_cast<std::uint64_t>(ptr - src->view.data());
+        const auto offset = static_cast<std::uint64_t>(ptr - base);
         assert(offset < max_offset);
-        const auto limit = src->view.size();
-        std::uint64_t idx = 0;
-        while (idx < limit and ptr[idx] != carriage_return and ptr[idx] != line_feed)
-            ++idx;
-        assert(idx < max_extent);
+        const auto remaining = static_cast<std::uint64_t>(limit - ptr);
+        auto [idx, indent] = line_scanner(ptr, remaining);
         cache.isle.offset = offset;
-        cache.isle.length = idx;
+        cache.isle.length = std::min(idx, Isle::overflow);
+        cache.indent = std::min(indent, Isle::overflow);
         ++cache.number;
-        for (cache.indent = 0; cache.indent < idx and white_space(ptr[cache.indent]); ++cache.indent)
-            ;
 
         // Skip the new line marker.
-        if (idx < limit)
+        if (idx < remaining)
         {
-            if (ptr[idx] == carriage_return and idx+1 < limit and ptr[idx+1] == line_feed)
+            if (ptr[idx] == carriage_return and idx+1 < remaining and ptr[idx+1] == line_feed)
                 ++idx;
             ++idx;
         }
         ptr += idx;
     }
 
-    SourceFile::LineRange::LineRange(const SourceFile& src) : src{&src}, ptr{src.view.data()}
+    SourceFile::View SourceFile::contents(Isle m) const noexcept
+    {
+        assert(m.offset + m.length <= view.size());
+        return { view.data() + m.offset, m.length };
+    }
+
+    SourceFile::View SourceFile::contents(Isle m, const LineDepot& depot) const
+    {
+        const auto length = depot.length(m);
+        assert(m.offset + length <= view.size());
+        return { view.data() + m.offset, length };
+    }
+
+    std::uint64_t LineDepot::long_length(Isle i) const
+    {
+        auto where = std::ranges::lower_bound(long_isles, std::uint64_t{i.offset}, { }, &LongIsle::offset);
+        assert(where != long_isles.end() and where->offset == i.offset);
+        return where->length;
+    }
+
+    SourceFile::LineRange::LineRange(const SourceFile& src) : LineRange{src.view, src.view}
+    { }
+
+    SourceFile::LineRange::LineRange(const SourceFile& src, View part) : LineRange{src.view, part}
+    { }
+
+    SourceFile::LineRange::LineRange(View text, View part)
+        : base{text.data()}, ptr{part.data()}, limit{part.data() + part.size()}
     {
         // Skip a possible misguided UTF-8 BOM.
-        if (src.view.size() >= 3 and ptr[0] == 0xEF and ptr[1] == 0xBB and ptr[2] == 0xBF)
+        if (ptr == base and part.size() >= 3 and ptr[0] == 0xEF and ptr[1] == 0xBB and ptr[2] == 0xBF)
             ptr += 3;
         next_line();
     }
@@ -215,7 +732,7 @@ namespace ipr::input {
     SourceFile::LineRange::iterator& SourceFile::LineRange::iterator::operator++() noexcept
     {
         assert(range != nullptr);
-        if (range->ptr >= range->src->view.data() + range->src->view.size())
+        if (range->ptr >= range->limit)
             range = nullptr;
         else
             range->next_line();
@@ -230,12 +747,7 @@ namespace ipr::input {
             LineSpecies species;
         };
 
-        constexpr auto cmp_dir_by_name = [](auto& x, auto& y) constexpr {
-            return std::u8string_view{x.name} < std::u8string_view{y.name};
-        };
-
         // A mapping of standard directive spelling to line species.
-        // Note: This table is stored in alphabetic order of the spelling.
         constexpr StandardDirective standard_directives[] {
             {u8"define", LineSpecies::Define},
             {u8"elif", LineSpecies::Elif},
@@ -257,147 +769,1800 @@ namespace ipr::input {
             {u8"warning", LineSpecies::Warning},
         };
 
-        static_assert(std::ranges::is_sorted(standard_directives, cmp_dir_by_name));
+        // Perfect hash of the spellings of the standard directives, on a non-empty spelling.
+        constexpr std::size_t directive_hash(std::u8string_view s)
+        {
+            return (5 * s.size() + s.front() + s.back()) % 32;
+        }
+
+        // The standard directives, indexed by the hash of their spelling.
+        constexpr auto directive_slots = [] {
+            std::array<const StandardDirective*, 32> slots { };
+            for (auto& x : standard_directives)
+                slots[directive_hash(x.name)] = &x;
+            return slots;
+        }();
+
+        static_assert(std::ranges::all_of(standard_directives, [](auto& x) {
+            return directive_slots[directive_hash(x.name)] == &x
+                and (char_classes[x.name[0]] & char_class::directive_initial);
+        }), "directive_hash shall not collide, and the table shall flag the initials of directives");
 
         // If the argument for `s` is the spelling of a standard preprocessing directive,
         // return a pointer to the corresponding precomputed map entry.  Otherwise, return null.
         const StandardDirective* get_standard_directive(std::u8string_view s)
         {
-            auto where = std::ranges::lower_bound(standard_directives, s, { }, &StandardDirective::name);
-            if (where == std::end(standard_directives) or where->name > s)
+            if (s.empty())
+                return nullptr;
+            auto entry = directive_slots[directive_hash(s)];
+            if (entry == nullptr or entry->name != s)
                 return nullptr;
-            return where;
+            return entry;
         }
 
         // This predicate holds if the argument for `c` denotes the first character of a standard
         // preprocessing directive.
         inline bool may_begin_standard_directive(char8_t c)
         {
-            switch (c) {
-            case u8'd': case u8'e': case u8'i': case u8'l':
-            case u8'p': case u8'u': case u8'w':
-                return true;
-            default:
-                return false;
-            }
+            return char_classes[c] & char_class::directive_initial;
         }
 
-        // Quick and simple predicate for constitutents of a narrow identifier.
-        inline bool narrow_letter_or_digit(char8_t c)
+        // Length of the longest standard directive spelling.
+        constexpr std::size_t max_directive_length = [] {
+            std::size_t n = 0;
+            for (auto& x : standard_directives)
+                n = std::max(n, std::u8string_view{x.name}.size());
+            return n;
+        }();
+
+        // This predicate holds if the characters following an `import` or `module` keyword at the
+        // start of a line make that line a module directive, as opposed to ordinary text using
+        // `import` or `module` as an identifier.  See P1857.
+        template<typename Cursor>
+        bool module_directive_operand(Cursor cursor)
         {
-            return (c >= u8'A' and c <= u8'Z')
-                or (c >= u8'z' and c <= u8'z')
-                or (c >= u8'0' and c <= u8'9')
-                or c == u8'_';
+            skip_blank(cursor);
+            if (cursor.done())
+                return false;
+            switch (auto c = *cursor) {
+            case u8'<': case u8'"': case u8';':
+                return true;
+            case u8':':
+                cursor.advance();
+                return cursor.done() or *cursor != u8':';
+            default:
+                return narrow_letter_or_digit(c) or c >= 0x80;
+            }
         }
 
-        // Advance the argument bound to `cursor` past the next consecutive whitespace characters.
-        inline void skip_blank(const char8_t*& cursor, const char8_t* end)
+        // Return the species of a line not starting with `#`: either a module directive, starting
+        // with the keyword `import`, or `export` followed by `import` or `module`; or else text.
+        template<typename Cursor>
+        LineSpecies keyword_species(Cursor cursor)
         {
-            while (cursor < end and white_space(*cursor))
-                ++cursor;
+            if (*cursor != u8'i' and *cursor != u8'e')
+                return LineSpecies::Text;
+            char8_t buffer[6];
+            auto name = gather_name(cursor, buffer);
+            if (name == u8"import")
+                return module_directive_operand(cursor) ? LineSpecies::Import : LineSpecies::Text;
+            else if (name != u8"export")
+                return LineSpecies::Text;
+            skip_blank(cursor);
+            name = gather_name(cursor, buffer);
+            if ((name == u8"import" or name == u8"module") and module_directive_operand(cursor))
+                return LineSpecies::Export;
+            return LineSpecies::Text;
         }
 
-        // Return the species of a logical line.
-        LineSpecies species(SourceFile::View line)
+        // Return the species of a logical line, the characters of which are delivered by a cursor.
+        template<typename Cursor>
+        LineSpecies species(Cursor cursor)
         {
-            auto cursor = line.data();
-            const auto line_end = cursor + line.size();
-            skip_blank(cursor, line_end);
-            if (cursor == line_end)
+            skip_blank(cursor);
+            if (cursor.done())
                 return LineSpecies::Unknown;
             else if (*cursor != u8'#')
-                return LineSpecies::Text;
+                return keyword_species(cursor);
 
-            skip_blank(++cursor, line_end);
-            if (cursor == line_end)
+            cursor.advance();
+            skip_blank(cursor);
+            if (cursor.done())
                 return LineSpecies::SolitaryHash;
             if (not may_begin_standard_directive(*cursor))
                 return LineSpecies::ExtendedDirective;
-            
-            const auto directive_start = cursor;
-            while (cursor < line_end and narrow_letter_or_digit(*cursor))
-                ++cursor;
-            if (auto directive = get_standard_directive({directive_start, cursor}))
+
+            char8_t buffer[max_directive_length];
+            if (auto directive = get_standard_directive(gather_name(cursor, buffer)))
                 return directive->species;
             return LineSpecies::ExtendedDirective;
         }
 
-        // Return the species of a composite logical line.
-        LineSpecies species(const SourceFile& src, const CompositeLine& composite)
+        // Return the species of a simple logical line.
+        LineSpecies species(SourceFile::View line)
         {
-            // FIXME: Building a buffer is not strictly needed in most practical cases.
-            std::u8string buffer;
-            for (auto& line : composite.lines)
-            {
-                auto chars = src.contents(line.isle);
-                buffer.append(chars.data(), chars.size());
-            }
-            return species(buffer);
+            return species(LineCursor{line});
         }
 
-        LineDepot read_lines(const SourceFile& src)
+        // Return the species of a composite logical line of a line depot.
+        LineSpecies species(const char8_t* text, const LineDepot& depot, CompositeLine composite)
         {
-            LineDepot depot { };
-            const auto file_start = src.contents().data();
+            return species(SplicedCursor{text, depot, composite});
+        }
+
+        // Return the number of bytes of a physical line of `length` bytes up to, and including, its
+        // last non-blank character.
+        inline std::uint64_t trimmed_length(const char8_t* line_start, std::uint64_t length, const PhysicalLine& line)
+        {
+            auto extent = length;
+            while (extent > line.indent and white_space(line_start[extent - 1]))
+                --extent;
+            return extent;
+        }
 
-            CompositeLine composite { };
-            for (auto line: src.lines())
+        // Value of an offset designating no byte of a text.
+        constexpr auto no_offset = ~std::uint64_t{};
+
+        // Builder of logical lines from the physical lines of a text, fed in order of appearance.
+        // The logical lines are appended to a line depot.  On request, each physical line is also
+        // validated as UTF-8 while its bytes are still in cache; line terminators being ASCII
+        // characters, no well-formed sequence straddles two physical lines.
+        struct LineReader {
+            LineReader(SourceFile::View text, LineDepot& depot, bool validate = false)
+                : text{text.data()}, limit{text.data() + text.size()}, depot{depot},
+                  composite_start{depot.spliced.size()}, long_start{depot.long_isles.size()},
+                  validate{validate}
+            { }
+
+            // Offset of the first ill-formed UTF-8 sequence found, if validating.
+            std::uint64_t invalid_offset() const { return invalid; }
+
+            // This predicate holds if a composite line is being assembled.
+            bool splicing() const { return depot.spliced.size() > composite_start; }
+
+            void read(PhysicalLine line)
             {
-                if (line.empty())
-                    continue;
+                const auto line_start = text + line.isle.offset;
+                auto length = std::uint64_t{line.isle.length};
+                if (length == Isle::overflow) [[unlikely]]
+                    length = line_scanner(line_start, limit - line_start).length;
+                if (validate and invalid == no_offset)
+                {
+                    if (auto bad = utf8_validator(line_start, length); bad != length)
+                        invalid = line.isle.offset + bad;
+                }
                 // Trim any trailing whitespace character when determining logical line continuation.
-                const auto line_start = file_start + line.isle.offset + line.indent;
-                auto extent = line.isle.length;
-                while (--extent > line.indent and white_space(line_start[extent]))
-                    ;
-                if (line_start[extent] == u8'\\')
-                {
-                    line.isle.length = extent;
-                    composite.lines.push_back(line);
-                    continue;
+                const auto extent = trimmed_length(line_start, length, line);
+                if (extent > line.indent and line_start[extent - 1] == u8'\\')
+                {
+                    if (not splicing())
+                        long_start = depot.long_isles.size();
+                    depot.spliced.push_back(fit(line, extent - 1));
+                }
+                else if (splicing())
+                {
+                    depot.spliced.push_back(fit(line, length));
+                    splice();
+                }
+                else if (extent > line.indent)     // skip entirely blank logical lines.
+                {
+                    auto idx = depot.simples.size();
+                    auto spc = species({line_start + line.indent, extent - line.indent});
+                    depot.indices.emplace_back(LineSort::Simple, spc, idx);
+                    depot.simples.emplace_back(fit(line, length));
+                }
+            }
+
+            // A continuation on the very last line still ends the logical line.
+            void finish()
+            {
+                if (splicing())
+                    splice();
+            }
+
+        private:
+            // Return the argument line with its isle set to `length` bytes, recording a long isle.
+            PhysicalLine fit(PhysicalLine line, std::uint64_t length)
+            {
+                if (length >= Isle::overflow) [[unlikely]]
+                {
+                    depot.long_isles.push_back({ line.isle.offset, length });
+                    length = Isle::overflow;
                 }
-                else if (not composite.lines.empty())
+                line.isle.length = length;
+                return line;
+            }
+
+            // Turn the physical lines accumulated since `composite_start` into a composite line.
+            void splice()
+            {
+                auto& spliced = depot.spliced;
+                // The count of isles of an archipelago is a 16-bit field.
+                if (spliced.size() - composite_start >= max_extent) [[unlikely]]
+                    throw SpliceError{ spliced[composite_start].number };
+                const Archipelago archipelago { .start = composite_start, .count = spliced.size() - composite_start };
+                // A sequence of spliced blank lines does not form a logical line.
+                if (auto spc = species(text, depot, depot.composite(archipelago)); spc != LineSpecies::Unknown)
                 {
-                    composite.lines.push_back(line);
                     auto idx = depot.composites.size();
-                    depot.composites.push_back(composite);
-                    auto spc = species(src, composite);
+                    depot.composites.push_back(archipelago);
                     depot.indices.emplace_back(LineSort::Composite, spc, idx);
-                    composite.lines.clear();
                 }
-                else if (extent == line.indent)
-                    continue;               // skip entirely blank logical lines.
                 else
                 {
-                    auto idx = depot.simples.size();
-                    auto spc = species({line_start, extent});
-                    depot.indices.emplace_back(LineSort::Simple, spc, idx);
-                    depot.simples.emplace_back(line);
+                    spliced.resize(composite_start);
+                    depot.long_isles.resize(long_start);
                 }
+                composite_start = spliced.size();
             }
 
-            return depot;
+            const char8_t* text;
+            const char8_t* limit;
+            LineDepot& depot;
+            std::size_t composite_start;        // The physical lines of the composite line being
+                                                // assembled are directly accumulated in the depot.
+            std::size_t long_start;             // Long isles of the composite line being assembled.
+            bool validate;
+            std::uint64_t invalid = no_offset;
+        };
+
+        // Logical lines read from a portion of an input source file.
+        struct LineHarvest {
+            LineDepot depot;
+            std::uint64_t physical_lines;   // number of physical lines in that portion.
+            std::uint64_t invalid;          // offset of the first ill-formed UTF-8 sequence, if validated.
+        };
+
+        LineHarvest read_lines(SourceFile::View text, SourceFile::LineRange range, bool validate)
+        {
+            LineHarvest harvest { };
+            LineReader reader { text, harvest.depot, validate };
+            for (auto line: range)
+            {
+                harvest.physical_lines = line.number;
+                reader.read(line);
+            }
+            reader.finish();
+            harvest.invalid = reader.invalid_offset();
+            return harvest;
         }
-    }
 
-    SourceListing::SourceListing(const SystemPath& path) 
-        : SourceFile{path}, depot{read_lines(*this)}
-    { }
+        // Files smaller than this are not worth reading with several threads.
+        constexpr std::uint64_t min_chunk_size = std::uint64_t{1} << 18;
 
-    const SimpleLine& SourceListing::simple_line(LineDescriptor line) const
-    {
-        assert(idx.sort() == LineSort::Simple);
-        auto n = line.index();
-        assert(n < depot.simples.size());
-        return depot.simples[n];
-    }
+        // This predicate holds if the physical line terminated by the line feed at `pos` is continued
+        // by a backslash onto the next physical line.
+        bool continued_line(SourceFile::View text, std::size_t pos)
+        {
+            assert(text[pos] == line_feed);
+            if (pos > 0 and text[pos - 1] == carriage_return)
+                --pos;
+            while (pos > 0 and white_space(text[pos - 1]))
+                --pos;
+            return pos > 0 and text[pos - 1] == u8'\\';
+        }
 
-    const CompositeLine& SourceListing::composite_line(LineDescriptor line) const
-    {
-        assert(idx.sort() == LineSort::Composite);
-        auto n = line.index();
-        assert(n < depot.composites.size());
-        return depot.composites[n];
+        // Return the start of the first logical line beginning at, or after, `pos`, and that
+        // immediately follows a line feed.  Return the size of the text if there is none.
+        std::size_t next_logical_boundary(SourceFile::View text, std::size_t pos)
+        {
+            while (pos < text.size())
+            {
+                auto eol = std::find(text.begin() + pos, text.end(), line_feed);
+                if (eol == text.end())
+                    break;
+                pos = eol - text.begin();
+                if (not continued_line(text, pos))
+                    return pos + 1;
+                ++pos;
+            }
+            return text.size();
+        }
+
+        // Read the lines of `src` in chunks, each read by a thread of its own.  Chunks start at
+        // logical line boundaries, so that no continuation crosses chunks.  The partial depots are
+        // then stitched in order, with their indices and line numbers rebased.
+        LineHarvest read_lines(const SourceFile& src, unsigned threads, bool validate)
+        {
+            const auto text = src.contents();
+            if (threads == 0)
+                threads = std::max(1u, std::thread::hardware_concurrency());
+            const auto chunk_count = std::min<std::uint64_t>(threads, text.size() / min_chunk_size);
+            if (chunk_count < 2)
+                return read_lines(text, src.lines(), validate);
+
+            std::vector<std::size_t> bounds { 0 };
+            for (std::uint64_t i = 1; i < chunk_count; ++i)
+            {
+                auto pos = next_logical_boundary(text, std::max(bounds.back(), text.size() / chunk_count * i));
+                if (pos == text.size())
+                    break;
+                bounds.push_back(pos);
+            }
+            bounds.push_back(text.size());
+
+            std::vector<std::future<LineHarvest>> chunks;
+            for (std::size_t i = 0; i + 1 < bounds.size(); ++i)
+            {
+                const auto part = text.subspan(bounds[i], bounds[i + 1] - bounds[i]);
+                chunks.push_back(std::async(std::launch::async, [text, part, validate] {
+                    return read_lines(text, SourceFile::LineRange{text, part}, validate);
+                }));
+            }
+
+            std::vector<LineHarvest> harvests;
+            for (auto& chunk : chunks)
+                harvests.push_back(chunk.get());
+
+            LineHarvest result { std::move(harvests.front()) };
+            auto& depot = result.depot;
+            std::uint64_t line_base = harvests.front().physical_lines;
+            for (auto& harvest : std::span{harvests}.subspan(1))
+            {
+                result.invalid = std::min(result.invalid, harvest.invalid);
+                const auto simple_base = depot.simples.size();
+                const auto composite_base = depot.composites.size();
+                const auto spliced_base = depot.spliced.size();
+                for (auto line : harvest.depot.simples)
+                {
+                    line.line.number += line_base;
+                    depot.simples.push_back(line);
+                }
+                for (auto line : harvest.depot.spliced)
+                {
+                    line.number += line_base;
+                    depot.spliced.push_back(line);
+                }
+                for (auto composite : harvest.depot.composites)
+                    depot.composites.push_back({ .start = spliced_base + composite.start, .count = composite.count });
+                depot.long_isles.insert(depot.long_isles.end(), harvest.depot.long_isles.begin(), harvest.depot.long_isles.end());
+                for (auto x : harvest.depot.indices)
+                {
+                    auto base = x.sort() == LineSort::Simple ? simple_base : composite_base;
+                    depot.indices.emplace_back(x.sort(), x.species(), base + x.index());
+                }
+                line_base += harvest.physical_lines;
+            }
+            result.physical_lines = line_base;
+            return result;
+        }
+
+        // Return the line depot of a harvest from the file designated by `path`, unless the harvest
+        // found the file not to be well-formed UTF-8.
+        LineDepot checked_depot(const SystemPath& path, LineHarvest&& harvest)
+        {
+            if (harvest.invalid != no_offset)
+                throw EncodingError{ path, harvest.invalid };
+            return std::move(harvest.depot);
+        }
+    }
+
+    namespace {
+        // Return the first physical line of a logical line.
+        const PhysicalLine& first_line(const LineDepot& depot, LineDescriptor x)
+        {
+            if (x.sort() == LineSort::Simple)
+                return depot.simples[x.index()].line;
+            return depot.spliced[depot.composites[x.index()].start];
+        }
+
+        // Pending move of the offsets and line numbers of the logical lines of a depot, from the one
+        // at index `first` up to the first of the next shift, by `bytes` and `lines` modulo 2^64.
+        struct LineShift {
+            std::size_t first;
+            std::uint64_t bytes;
+            std::uint64_t lines;
+        };
+
+        // Shifts of a depot whose lines are all at their final offsets.
+        std::vector<LineShift> no_shift() { return { { 0, 0, 0 } }; }
+
+        // Append to `out` the logical lines of `depot` designated by the indices in [first, last).
+        // Their offsets are moved by `bytes`, and their line numbers by `lines`, modulo 2^64.
+        // The long isles are not carried over; `out` is expected to hold them at their final offsets.
+        void transfer_lines(LineDepot& out, const LineDepot& depot, std::size_t first, std::size_t last,
+                            std::uint64_t bytes, std::uint64_t lines)
+        {
+            const auto move = [&](PhysicalLine line) {
+                line.isle.offset = line.isle.offset + bytes;
+                line.number = line.number + lines;
+                return line;
+            };
+            for (auto x : std::span{depot.indices}.subspan(first, last - first))
+            {
+                if (x.sort() == LineSort::Simple)
+                {
+                    out.indices.emplace_back(LineSort::Simple, x.species(), out.simples.size());
+                    out.simples.push_back({ move(depot.simples[x.index()].line) });
+                }
+                else
+                {
+                    const auto& archipelago = depot.composites[x.index()];
+                    out.indices.emplace_back(LineSort::Composite, x.species(), out.composites.size());
+                    out.composites.push_back({ .start = out.spliced.size(), .count = archipelago.count });
+                    for (auto& line : depot.composite(archipelago).lines)
+                        out.spliced.push_back(move(line));
+                }
+            }
+        }
+
+        // Apply the pending shifts of a depot, dropping the physical lines no longer designated
+        // by any logical line.
+        void settle(LineDepot& depot, const std::vector<LineShift>& shifts)
+        {
+            LineDepot out { };
+            out.long_isles = std::move(depot.long_isles);
+            out.indices.reserve(depot.indices.size());
+            for (std::size_t i = 0; i < shifts.size(); ++i)
+            {
+                const auto last = i + 1 < shifts.size() ? shifts[i + 1].first : depot.indices.size();
+                transfer_lines(out, depot, shifts[i].first, last, shifts[i].bytes, shifts[i].lines);
+            }
+            depot = std::move(out);
+        }
+
+        // Logical lines of the old text replaced by lines read again from the new text.
+        struct LineReplacement {
+            std::size_t first;              // index of the first old logical line replaced.
+            std::size_t last;               // index past the last old logical line replaced.
+            std::size_t fresh_first;        // index of the first replacing logical line.
+            std::size_t fresh_last;         // index past the last replacing logical line.
+            std::uint64_t bytes;            // offset shift of the old logical lines that follow.
+            std::uint64_t lines;            // line number shift of the old logical lines that follow.
+        };
+
+        // Apply `edits` to the text described by `depot` with its pending `shifts`, to describe `text`.
+        // Each group of nearby edits is handled by reading again the new text from the start of the
+        // logical line containing the first edit, until reaching a logical line boundary past the
+        // last edit that coincides with the start of a logical line of the old text.  From that point
+        // on, the old and new texts are identical, modulo a shift, and so are their logical lines.
+        // The logical lines read again are appended to the tables of the depot, and their descriptors
+        // replace the old ones; the other logical lines are left in place, their moves being merely
+        // recorded in `shifts`.  So the cost of a revision is that of reading the lines touched by
+        // the edits, plus that of moving descriptors when the number of logical lines changes.
+        void revise_depot(LineDepot& depot, std::vector<LineShift>& shifts, SourceFile::View text,
+                          std::span<const TextEdit> edits)
+        {
+            assert(std::ranges::is_sorted(edits, { }, &TextEdit::offset));
+            const auto& olds = depot.indices;
+            // Offset and line number of the start of the old logical line at index `i`.
+            const auto start_of = [&](std::size_t i) {
+                const auto& s = *(std::ranges::upper_bound(shifts, i, { }, &LineShift::first) - 1);
+                const auto& line = first_line(depot, olds[i]);
+                return std::pair{ line.isle.offset + s.bytes, line.number + s.lines };
+            };
+            // Index of the first old logical line, at or after `i`, starting at or after offset `x`.
+            const auto first_from = [&](std::size_t i, std::uint64_t x) {
+                auto n = olds.size() - i;
+                while (n > 0)
+                {
+                    auto half = n / 2;
+                    if (start_of(i + half).first < x)
+                    {
+                        i += half + 1;
+                        n -= half + 1;
+                    }
+                    else
+                        n = half;
+                }
+                return i;
+            };
+
+            LineDepot fresh { };
+            std::vector<LineReplacement> replacements;
+            std::uint64_t shift = 0;        // offset shift from old to new text, past the edits considered so far.
+            std::uint64_t line_shift = 0;   // line number shift from old to new text, past the last edit group.
+            std::size_t next = 0;           // index of the next old logical line to consider.
+            std::size_t e = 0;              // index of the next edit to consider.
+            while (e < edits.size())
+            {
+                // Keep the logical lines preceding the one containing the first edit of this group.
+                std::uint64_t region = 0;   // start of the region of the new text to read again.
+                std::uint64_t base = 0;     // number of physical lines preceding that region.
+                auto a = first_from(next, edits[e].offset + 1);
+                if (a > next)
+                {
+                    --a;
+                    const auto [offset, number] = start_of(a);
+                    region = offset + shift;
+                    base = number - 1 + line_shift;
+                }
+
+                // End of the last edit of this group, in the new text.
+                std::uint64_t group_end = 0;
+                const auto take_edit = [&] {
+                    group_end = edits[e].offset + shift + edits[e].inserted.size();
+                    shift += edits[e].inserted.size() - edits[e].removed;
+                    ++e;
+                };
+                take_edit();
+
+                const auto fresh_first = fresh.indices.size();
+                LineReader reader { text, fresh };
+                next = olds.size();
+                for (auto line : SourceFile::LineRange{text, text.subspan(region)})
+                {
+                    const auto offset = std::uint64_t{line.isle.offset};
+                    if (offset >= group_end and not reader.splicing())
+                    {
+                        // Nearby edits join this group.
+                        while (e < edits.size() and edits[e].offset <= offset - shift)
+                            take_edit();
+                        if (offset >= group_end)
+                        {
+                            const auto b = first_from(a, offset - shift);
+                            if (b < olds.size() and start_of(b).first == offset - shift)
+                            {
+                                line_shift = base + line.number - start_of(b).second;
+                                next = b;
+                                break;
+                            }
+                        }
+                    }
+                    line.number += base;
+                    reader.read(line);
+                }
+                // Reading to the end of the text covers any edit left, e.g. further in the last line.
+                if (next == olds.size())
+                    reader.finish();
+                replacements.push_back({ a, next, fresh_first, fresh.indices.size(), shift, line_shift });
+                if (next == olds.size())
+                    break;
+            }
+            if (replacements.empty())
+                return;
+
+            // Long isles are kept at their final offsets; drop those of the replaced lines.
+            std::vector<LongIsle> long_isles;
+            auto r = replacements.begin();
+            for (auto isle : depot.long_isles)
+            {
+                while (r != replacements.end() and r->last < olds.size() and start_of(r->last).first <= isle.offset)
+                    ++r;
+                if (r != replacements.end() and start_of(r->first).first <= isle.offset)
+                    continue;
+                const auto bytes = r == replacements.begin() ? 0 : (r - 1)->bytes;
+                long_isles.push_back({ isle.offset + bytes, isle.length });
+            }
+            long_isles.insert(long_isles.end(), fresh.long_isles.begin(), fresh.long_isles.end());
+            std::ranges::sort(long_isles, { }, &LongIsle::offset);
+
+            // Append the lines read again, and lay out their descriptors along with the old ones.
+            const auto simple_base = depot.simples.size();
+            const auto composite_base = depot.composites.size();
+            const auto spliced_base = depot.spliced.size();
+            std::ranges::copy(fresh.simples, std::back_inserter(depot.simples));
+            std::ranges::copy(fresh.spliced, std::back_inserter(depot.spliced));
+            for (auto composite : fresh.composites)
+                depot.composites.push_back({ .start = spliced_base + composite.start, .count = composite.count });
+            for (auto& x : fresh.indices)
+            {
+                auto base = x.sort() == LineSort::Simple ? simple_base : composite_base;
+                x = { x.sort(), x.species(), base + x.index() };
+            }
+
+            std::vector<LineDescriptor> indices;
+            std::vector<LineShift> revised_shifts;
+            const auto carry = [&](std::size_t first, std::size_t last, std::uint64_t bytes, std::uint64_t lines) {
+                auto s = std::ranges::upper_bound(shifts, first, { }, &LineShift::first) - 1;
+                for (; s != shifts.end() and s->first < last; ++s)
+                {
+                    const auto position = indices.size() + std::max(s->first, first) - first;
+                    revised_shifts.push_back({ position, s->bytes + bytes, s->lines + lines });
+                }
+                indices.insert(indices.end(), olds.begin() + first, olds.begin() + last);
+            };
+            std::size_t kept = 0;           // index of the first old logical line not yet laid out.
+            std::uint64_t moved_bytes = 0;
+            std::uint64_t moved_lines = 0;
+            for (auto& x : replacements)
+            {
+                if (kept < x.first)
+                    carry(kept, x.first, moved_bytes, moved_lines);
+                revised_shifts.push_back({ indices.size(), 0, 0 });
+                indices.insert(indices.end(), fresh.indices.begin() + x.fresh_first, fresh.indices.begin() + x.fresh_last);
+                kept = x.last;
+                moved_bytes = x.bytes;
+                moved_lines = x.lines;
+            }
+            if (kept < olds.size())
+                carry(kept, olds.size(), moved_bytes, moved_lines);
+
+            // Drop the shifts of empty ranges, and merge those of adjacent ranges moved alike.
+            shifts.clear();
+            for (std::size_t i = 0; i < revised_shifts.size(); ++i)
+            {
+                const auto& s = revised_shifts[i];
+                if (i + 1 < revised_shifts.size() and revised_shifts[i + 1].first == s.first)
+                    continue;
+                if (shifts.empty())
+                    shifts.push_back({ 0, s.bytes, s.lines });
+                else if (shifts.back().bytes != s.bytes or shifts.back().lines != s.lines)
+                    shifts.push_back(s);
+            }
+            if (shifts.empty())
+                shifts = no_shift();
+            depot.indices = std::move(indices);
+            depot.long_isles = std::move(long_isles);
+        }
+    }
+
+    LineDepot revise_lines(const LineDepot& depot, SourceFile::View text, std::span<const TextEdit> edits)
+    {
+        auto revised = depot;
+        auto shifts = no_shift();
+        revise_depot(revised, shifts, text, edits);
+        settle(revised, shifts);
+        return revised;
+    }
+
+    // -- Listing cache.
+    // A cache entry is a native-endian image made of a header, followed by the bytes of the source file
+    // path (padded to a multiple of 8 bytes), followed by the tables of the line depot.  Table entries
+    // are stored as their in-memory representation, so that the tables are read back in bulk; the
+    // header records a fingerprint of that representation, which bit-fields leave to the compiler.
+    namespace {
+        constexpr char8_t cache_magic[8] { u8'I', u8'P', u8'R', u8'L', u8'I', u8'N', u8'E', u8'S' };
+        constexpr std::uint32_t cache_version = 4;
+
+        struct CacheHeader {
+            char8_t magic[8];
+            std::uint32_t version;
+            std::uint32_t path_size;            // number of bytes in the source file path.
+            std::uint64_t layout;               // see layout_fingerprint.
+            std::uint64_t file_size;
+            std::int64_t mtime;                 // last modification time, in file clock ticks, or unvouched.
+            std::uint64_t content_hash;
+            std::uint64_t simples;              // number of entries in each table of the depot.
+            std::uint64_t spliced;
+            std::uint64_t composites;
+            std::uint64_t indices;
+            std::uint64_t long_isles;
+            std::uint64_t checksum;             // hash of everything following the header.
+        };
+
+        // Modification time recorded for a file modified too recently for its modification time
+        // to tell its contents apart from later ones: the contents are then hashed on every read.
+        constexpr std::int64_t unvouched = std::numeric_limits<std::int64_t>::min();
+
+        // Fast, non-cryptographic, hash of a sequence of bytes.  Four independent lanes absorb
+        // 32 bytes at a time, so that the multiplications pipeline well.
+        std::uint64_t content_hash(std::span<const std::byte> bytes)
+        {
+            constexpr std::uint64_t k1 = 0x9E3779B97F4A7C15;
+            constexpr std::uint64_t k2 = 0xC2B2AE3D27D4EB4F;
+            const auto absorb = [](std::uint64_t h, std::uint64_t w) {
+                return std::rotl(h ^ (w * k1), 31) * k2;
+            };
+            const auto word = [](const std::byte* p) {
+                std::uint64_t w;
+                std::memcpy(&w, p, sizeof w);
+                return w;
+            };
+
+            std::uint64_t lanes[4] { k1, k2, ~k1, ~k2 };
+            auto p = bytes.data();
+            auto n = bytes.size();
+            for (; n >= 32; p += 32, n -= 32)
+                for (int i = 0; i < 4; ++i)
+                    lanes[i] = absorb(lanes[i], word(p + 8 * i));
+            auto h = bytes.size() * k1;
+            for (auto lane : lanes)
+                h = absorb(h, lane);
+            for (; n >= 8; p += 8, n -= 8)
+                h = absorb(h, word(p));
+            if (n > 0)
+            {
+                std::uint64_t w = 0;
+                std::memcpy(&w, p, n);
+                h = absorb(h, w);
+            }
+            // Final avalanche, from MurmurHash3.
+            h ^= h >> 33;
+            h *= 0xFF51AFD7ED558CCD;
+            h ^= h >> 33;
+            h *= 0xC4CEB9FE1A85EC53;
+            return h ^ (h >> 33);
+        }
+
+        template<typename T>
+        std::span<const std::byte> bytes_of(std::span<const T> s)
+        {
+            return std::as_bytes(s);
+        }
+
+        // Hash of the representation of sample entries of the tables of a line depot.  A cache
+        // entry is read only by builds laying out these entries alike.
+        std::uint64_t layout_fingerprint()
+        {
+            PhysicalLine line { };
+            line.isle.offset = 0x123456789AB;
+            line.isle.length = 0xCDEF;
+            line.number = 0x13579BDF2468;
+            line.indent = 0xACE0;
+            const Archipelago archipelago { .start = 0x2468ACE1357, .count = 0xBDF9 };
+            const LineDescriptor descriptor { LineSort::Composite, LineSpecies::Text, 0x123456789ABCDE };
+            const LongIsle isle { .offset = 0x1122334455667788, .length = 0x99AABBCCDDEEFF00 };
+            std::byte sample[sizeof line + sizeof archipelago + sizeof descriptor + sizeof isle];
+            auto p = sample;
+            p = std::copy_n(reinterpret_cast<const std::byte*>(&line), sizeof line, p);
+            p = std::copy_n(reinterpret_cast<const std::byte*>(&archipelago), sizeof archipelago, p);
+            p = std::copy_n(reinterpret_cast<const std::byte*>(&descriptor), sizeof descriptor, p);
+            std::copy_n(reinterpret_cast<const std::byte*>(&isle), sizeof isle, p);
+            return content_hash(sample);
+        }
+
+        // Return the modification time of a file, or nothing if it cannot be determined.
+        std::optional<std::int64_t> modification_time(const SystemPath& path)
+        {
+            std::error_code ec;
+            const auto t = std::filesystem::last_write_time(path, ec);
+            if (ec)
+                return { };
+            return t.time_since_epoch().count();
+        }
+
+        // Return the modification time to record for a file last modified at `mtime`: unvouched
+        // if the file was modified so recently that it could still be modified again within the
+        // same tick of the file system clock.
+        std::int64_t vouched_time(std::int64_t mtime)
+        {
+            using namespace std::chrono_literals;
+            using clock = std::filesystem::file_time_type::clock;
+            const auto now = clock::now().time_since_epoch().count();
+            const auto margin = std::chrono::duration_cast<std::filesystem::file_time_type::duration>(2s).count();
+            return mtime < now - margin ? mtime : unvouched;
+        }
+
+        // Identity of a source file, as recorded in the header of a cache entry.  A file without
+        // a known modification time has no identity that a cache entry could vouch for.
+        struct SourceIdentity {
+            SourceIdentity(const SystemPath& path, std::int64_t mtime, SourceFile::View contents)
+                : path{path}, mtime{vouched_time(mtime)}, contents{contents}
+            { }
+            std::span<const std::byte> path_bytes() const { return bytes_of(std::span{path}); }
+
+            // Hash of the contents of the file, computed on first use only: a cache entry recording
+            // the same size and vouched modification time is trusted without reading the contents.
+            std::uint64_t hash() const
+            {
+                if (not content)
+                    content = content_hash(std::as_bytes(contents));
+                return *content;
+            }
+
+            const SystemPath& path;
+            std::int64_t mtime;
+            SourceFile::View contents;
+            mutable std::optional<std::uint64_t> content;
+        };
+
+        // Return the identifier of the calling process.
+        unsigned long process_id()
+        {
+#ifdef _WIN32
+            return GetCurrentProcessId();
+#else
+            return static_cast<unsigned long>(getpid());
+#endif
+        }
+
+        // Return the pathname of a scratch file next to a cache entry.  The name is unique among
+        // all the writers of the cache: the process id tells processes apart, and the serial
+        // number tells apart the writes of a process.
+        std::filesystem::path scratch_entry(const std::filesystem::path& entry)
+        {
+            static std::atomic<std::uint64_t> serial { };
+            auto scratch = entry;
+            scratch += "." + std::to_string(process_id()) + "." + std::to_string(serial++);
+            return scratch;
+        }
+
+        // Return the pathname of the cache entry for a source file.
+        std::filesystem::path cache_entry(const ListingCache& cache, const SourceIdentity& id)
+        {
+            char name[17] { };
+            std::snprintf(name, sizeof name, "%016llx", static_cast<unsigned long long>(content_hash(id.path_bytes())));
+            return std::filesystem::path{cache.directory()} / (std::string{name} + ".lines");
+        }
+
+        constexpr std::uint64_t padded(std::uint64_t n) { return (n + 7) / 8 * 8; }
+
+        // Return the `n` entries of a table stored as their representation at `cursor`, which is
+        // advanced past them.  `filler` is any value of the entries.
+        template<typename T>
+        std::vector<T> load_table(const std::byte*& cursor, std::uint64_t n, const T& filler)
+        {
+            static_assert(std::is_trivially_copyable_v<T>);
+            std::vector<T> table(n, filler);
+            if (n > 0)
+                std::memcpy(static_cast<void*>(table.data()), cursor, n * sizeof(T));
+            cursor += n * sizeof(T);
+            return table;
+        }
+
+        // A line depot read from a cache entry, and whether that entry is to be written anew so as
+        // to record the current modification time of the source file.
+        struct CachedDepot {
+            LineDepot depot;
+            bool refresh;
+        };
+
+        // Decode the line depot image of a cache entry.  Raise std::domain_error if the image is
+        // not a faithful description of the lines of `src`.
+        CachedDepot decode_depot(SourceFile::View image, const SourceFile& src, const SourceIdentity& id)
+        {
+            CacheHeader header;
+            if (image.size() < sizeof header)
+                throw std::domain_error{"truncated cache header"};
+            std::memcpy(&header, image.data(), sizeof header);
+            const auto body = std::as_bytes(image.subspan(sizeof header));
+            const auto path = id.path_bytes();
+            if (not std::ranges::equal(header.magic, cache_magic) or header.version != cache_version
+                or header.layout != layout_fingerprint())
+                throw std::domain_error{"unknown cache format"};
+            if (header.file_size != src.contents().size() or header.path_size != path.size())
+                throw std::domain_error{"stale cache entry"};
+            // The contents are hashed only if the modification times do not vouch for them.
+            const bool vouched = id.mtime != unvouched and header.mtime == id.mtime;
+            if (not vouched and header.content_hash != id.hash())
+                throw std::domain_error{"stale cache entry"};
+            for (auto count : { header.simples, header.spliced, header.composites, header.indices, header.long_isles })
+                if (count > body.size())
+                    throw std::domain_error{"truncated cache entry"};
+            const auto size = sizeof(PhysicalLine) * (header.simples + header.spliced)
+                            + sizeof(Archipelago) * header.composites + sizeof(LineDescriptor) * header.indices
+                            + sizeof(LongIsle) * header.long_isles;
+            if (body.size() != padded(header.path_size) + size)
+                throw std::domain_error{"truncated cache entry"};
+            if (header.checksum != content_hash(body))
+                throw std::domain_error{"corrupted cache entry"};
+            if (not std::ranges::equal(body.first(path.size()), path))
+                throw std::domain_error{"cache entry for another file"};
+
+            auto cursor = body.data() + padded(header.path_size);
+            LineDepot depot { };
+            depot.simples = load_table(cursor, header.simples, SimpleLine{ });
+            depot.spliced = load_table(cursor, header.spliced, PhysicalLine{ });
+            depot.composites = load_table(cursor, header.composites, Archipelago{ .start = 0, .count = 0 });
+            depot.indices = load_table(cursor, header.indices, LineDescriptor{ LineSort::Simple, LineSpecies::Text, 0 });
+            depot.long_isles = load_table(cursor, header.long_isles, LongIsle{ });
+
+            const auto valid_line = [&header](const PhysicalLine& line) {
+                return line.isle.tag == 0 and line.isle.offset + line.isle.length <= header.file_size
+                    and line.indent <= line.isle.length;
+            };
+            if (not std::ranges::all_of(depot.simples, valid_line, &SimpleLine::line) or not std::ranges::all_of(depot.spliced, valid_line))
+                throw std::domain_error{"invalid physical line"};
+            const auto valid_composite = [&header](const Archipelago& x) {
+                return x.tag == 1 and x.start + x.count <= header.spliced;
+            };
+            if (not std::ranges::all_of(depot.composites, valid_composite))
+                throw std::domain_error{"invalid composite line"};
+            const auto valid_descriptor = [&header](LineDescriptor x) {
+                const auto count = x.sort() == LineSort::Simple ? header.simples : header.composites;
+                return valid_species(x.species()) and x.index() < count;
+            };
+            if (not std::ranges::all_of(depot.indices, valid_descriptor))
+                throw std::domain_error{"invalid line descriptor"};
+            for (std::size_t i = 0; i < depot.long_isles.size(); ++i)
+            {
+                const auto isle = depot.long_isles[i];
+                if (isle.length < Isle::overflow or isle.length > header.file_size
+                    or isle.offset > header.file_size - isle.length
+                    or (i > 0 and isle.offset <= depot.long_isles[i - 1].offset))
+                    throw std::domain_error{"invalid long isle"};
+            }
+            const auto recorded = [&depot](const PhysicalLine& line) {
+                return line.isle.length != Isle::overflow
+                    or std::ranges::binary_search(depot.long_isles, std::uint64_t{line.isle.offset}, { }, &LongIsle::offset);
+            };
+            if (not std::ranges::all_of(depot.simples, recorded, &SimpleLine::line) or not std::ranges::all_of(depot.spliced, recorded))
+                throw std::domain_error{"unrecorded long isle"};
+            return { std::move(depot), not vouched and id.mtime != unvouched };
+        }
+
+        // Write the image of a line depot in a cache entry.  The entry is replaced atomically, so
+        // that concurrent readers never see a partially written entry.
+        void store_depot(const LineDepot& depot, const std::filesystem::path& entry, const SourceFile& src, const SourceIdentity& id)
+        {
+            const auto path = id.path_bytes();
+            std::vector<std::byte> bytes(padded(path.size()));
+            std::ranges::copy(path, bytes.begin());
+            const auto put = [&bytes](const auto& table) {
+                const auto b = std::as_bytes(std::span{table});
+                bytes.insert(bytes.end(), b.begin(), b.end());
+            };
+            put(depot.simples);
+            put(depot.spliced);
+            put(depot.composites);
+            put(depot.indices);
+            put(depot.long_isles);
+
+            CacheHeader header { };
+            std::ranges::copy(cache_magic, header.magic);
+            header.version = cache_version;
+            header.path_size = path.size();
+            header.layout = layout_fingerprint();
+            header.file_size = src.contents().size();
+            header.mtime = id.mtime;
+            header.content_hash = id.hash();
+            header.simples = depot.simples.size();
+            header.spliced = depot.spliced.size();
+            header.composites = depot.composites.size();
+            header.indices = depot.indices.size();
+            header.long_isles = depot.long_isles.size();
+            header.checksum = content_hash(bytes);
+
+            const auto scratch = scratch_entry(entry);
+            std::error_code ec;
+            {
+                std::ofstream out{scratch, std::ios::binary};
+                out.write(reinterpret_cast<const char*>(&header), sizeof header);
+                out.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+                if (not out)
+                {
+                    out.close();
+                    std::filesystem::remove(scratch, ec);
+                    return;
+                }
+            }
+            std::filesystem::rename(scratch, entry, ec);
+            if (ec)
+                std::filesystem::remove(scratch, ec);
+        }
+    }
+
+    ListingCache::ListingCache(const SystemPath& path) : dir{path}
+    {
+        std::filesystem::create_directories(dir);
+    }
+
+    CacheStatistics ListingCache::statistics() const
+    {
+        return { hits.load(), misses.load(), rejects.load() };
+    }
+
+    LineDepot SourceListing::read_depot(const SystemPath& path, const ListingOptions& options)
+    {
+        if (options.cache == nullptr or path.empty())
+            return checked_depot(path, read_lines(*this, options.threads, options.validate_utf8));
+
+        const auto mtime = modification_time(path);
+        if (not mtime)
+            return checked_depot(path, read_lines(*this, options.threads, options.validate_utf8));
+
+        auto& cache = *options.cache;
+        const SourceIdentity id { path, *mtime, contents() };
+        const auto entry = cache_entry(cache, id);
+        std::error_code ec;
+        if (std::filesystem::exists(entry, ec))
+        {
+            std::optional<LineDepot> depot;
+            try {
+                auto cached = decode_depot(SourceFile{entry.native()}.contents(), *this, id);
+                ++cache.hits;
+                if (cached.refresh)
+                    store_depot(cached.depot, entry, *this, id);
+                depot = std::move(cached.depot);
+            }
+            catch (const std::domain_error&) {
+                ++cache.rejects;
+            }
+            catch (const AccessError&) { }          // Entry removed by another writer: a miss.
+            catch (const RegularFileError&) { }
+            catch (const FileMappingError&) { }
+            // No line is scanned on a hit, so the contents are validated on their own.
+            if (depot and options.validate_utf8)
+            {
+                if (auto bad = first_invalid_utf8(contents()); bad != contents().size())
+                    throw EncodingError{ path, bad };
+            }
+            if (depot)
+                return std::move(*depot);
+        }
+        ++cache.misses;
+        auto depot = checked_depot(path, read_lines(*this, options.threads, options.validate_utf8));
+        store_depot(depot, entry, *this, id);
+        return depot;
+    }
+
+    // Starts of the physical lines of a listing, built on first use.  Offsets are stored on 32 bits
+    // when the text is small enough, which is the common case.
+    struct SourceListing::LineIndex {
+        std::once_flag built;
+        std::vector<std::uint32_t> narrow;
+        std::vector<std::uint64_t> wide;
+    };
+
+    SourceListing::SourceListing(const SystemPath& path, const ListingOptions& options)
+        : SourceFile{path},
+          depot{read_depot(path, options)},
+          line_index{std::make_unique<LineIndex>()}
+    { }
+
+    SourceListing::SourceListing(const SystemPath& path, SourceFile&& file, const ListingOptions& options)
+        : SourceFile{std::move(file)},
+          depot{read_depot(path, options)},
+          line_index{std::make_unique<LineIndex>()}
+    { }
+
+    SourceListing::SourceListing(SourceFile&& file, const ListingOptions& options)
+        : SourceListing{SystemPath{ }, std::move(file), options}
+    { }
+
+    SourceListing::SourceListing(SourceFile&& file, LineDepot&& lines)
+        : SourceFile{std::move(file)},
+          depot{std::move(lines)},
+          line_index{std::make_unique<LineIndex>()}
+    { }
+
+    SourceListing::SourceListing(SourceListing&&) noexcept = default;
+    SourceListing::~SourceListing() = default;
+
+    // Shifts pending on the lines of a listing since its last update, applied on first use.
+    struct SourceListing::Revision {
+        std::once_flag settled;
+        std::vector<LineShift> shifts;
+    };
+
+    const LineDepot& SourceListing::settled() const
+    {
+        if (revision)
+            std::call_once(revision->settled, [this] {
+                settle(depot, revision->shifts);
+                revision->shifts = no_shift();
+            });
+        return depot;
+    }
+
+    void SourceListing::update(SourceFile&& text, std::span<const TextEdit> edits)
+    {
+        auto pending = std::make_unique<Revision>();
+        pending->shifts = revision ? revision->shifts : no_shift();
+        revise_depot(depot, pending->shifts, text.contents(), edits);
+        std::swap(view, text.view);
+        std::swap(storage, text.storage);
+        revision = std::move(pending);
+        line_index = std::make_unique<LineIndex>();
+    }
+
+    namespace {
+        // Return the index of the last element of a non-empty sorted sequence not greater than `x`,
+        // or 0 if there is none.  Line lengths tend to be uniform over a text, so the search starts
+        // at an interpolated guess, then gallops towards `x` to bracket it, then bisects.
+        template<typename T>
+        std::size_t last_not_after(const std::vector<T>& starts, std::uint64_t x, std::uint64_t size)
+        {
+            const auto n = starts.size();
+            auto guess = static_cast<std::size_t>(static_cast<double>(x) / (size + 1) * n);
+            guess = std::min(guess, n - 1);
+            std::size_t low = 0;            // starts[low] <= x, unless low is 0.
+            std::size_t high = n;           // starts[high] > x, unless high is n.
+            std::size_t step = 1;
+            if (starts[guess] <= x)
+            {
+                low = guess;
+                while (low + step < n and starts[low + step] <= x)
+                {
+                    low += step;
+                    step *= 2;
+                }
+                high = std::min(low + step, n);
+            }
+            else
+            {
+                high = guess;
+                while (high >= step and starts[high - step] > x)
+                {
+                    high -= step;
+                    step *= 2;
+                }
+                low = high >= step ? high - step : 0;
+            }
+            while (high - low > 1)
+            {
+                const auto mid = low + (high - low) / 2;
+                if (starts[mid] <= x)
+                    low = mid;
+                else
+                    high = mid;
+            }
+            return low;
+        }
+    }
+
+    LineColumn SourceListing::position(std::uint64_t offset) const
+    {
+        const auto text = contents();
+        assert(offset <= text.size());
+        auto& index = *line_index;
+        std::call_once(index.built, [&] {
+            const bool narrow = text.size() <= std::numeric_limits<std::uint32_t>::max();
+            for (auto line : lines())
+            {
+                if (narrow)
+                    index.narrow.push_back(line.isle.offset);
+                else
+                    index.wide.push_back(line.isle.offset);
+            }
+        });
+
+        std::size_t n = 0;
+        std::uint64_t start = 0;
+        if (not index.narrow.empty())
+        {
+            n = last_not_after(index.narrow, offset, text.size());
+            start = index.narrow[n];
+        }
+        else if (not index.wide.empty())
+        {
+            n = last_not_after(index.wide, offset, text.size());
+            start = index.wide[n];
+        }
+        // Note: An offset within the byte order mark precedes the start of the first line.
+        if (offset < start)
+            return { 1, 1 };
+        // The column of a byte is that of the code point it is part of.
+        if (offset < text.size())
+            return { n + 1, code_point_counter(text.data() + start, offset + 1 - start) };
+        return { n + 1, code_point_counter(text.data() + start, offset - start) + 1 };
+    }
+
+    const SimpleLine& SourceListing::simple_line(LineDescriptor line) const
+    {
+        assert(line.sort() == LineSort::Simple);
+        auto n = line.index();
+        auto& lines = settled();
+        assert(n < lines.simples.size());
+        return lines.simples[n];
+    }
+
+    CompositeLine SourceListing::composite_line(LineDescriptor line) const
+    {
+        assert(line.sort() == LineSort::Composite);
+        auto n = line.index();
+        auto& lines = settled();
+        assert(n < lines.composites.size());
+        return lines.composite(lines.composites[n]);
+    }
+
+    namespace {
+        // Return the number of the first physical line of a logical line of a listing.
+        std::uint64_t line_number(const SourceListing& listing, LineDescriptor x)
+        {
+            if (x.sort() == LineSort::Simple)
+                return listing.simple_line(x).line.number;
+            return listing.composite_line(x).lines.front().number;
+        }
+
+        // Return the result of applying `f` to a cursor over the characters of a logical line of a listing.
+        template<typename F>
+        auto on_line(const SourceListing& listing, LineDescriptor x, F f)
+        {
+            if (x.sort() == LineSort::Simple)
+                return f(LineCursor{listing.contents(listing.simple_line(x).line.isle, listing.line_depot())});
+            return f(SplicedCursor{listing.contents().data(), listing.line_depot(), listing.composite_line(x)});
+        }
+
+        // Advance the cursor to the end of its line, keeping track of block comments.  The argument
+        // bound to `open_comment` indicates whether a block comment left open by a previous line is
+        // continued; on return, it indicates whether a block comment is left open.  Comment delimiters
+        // within string and character literals are ignored; a quote following a digit is taken for
+        // a digit separator.
+        template<typename Cursor>
+        void track_comments(Cursor cursor, bool& open_comment)
+        {
+            char8_t previous = 0;
+            while (not cursor.done())
+            {
+                const auto c = *cursor;
+                cursor.advance();
+                if (open_comment)
+                {
+                    if (c == u8'*' and not cursor.done() and *cursor == u8'/')
+                    {
+                        cursor.advance();
+                        open_comment = false;
+                    }
+                }
+                else if (c == u8'"' or (c == u8'\'' and not (previous >= u8'0' and previous <= u8'9')))
+                {
+                    while (not cursor.done() and *cursor != c)
+                    {
+                        if (*cursor == u8'\\')
+                            cursor.advance();
+                        if (not cursor.done())
+                            cursor.advance();
+                    }
+                    if (not cursor.done())
+                        cursor.advance();
+                }
+                else if (c == u8'/' and not cursor.done())
+                {
+                    if (*cursor == u8'/')
+                        return;
+                    if (*cursor == u8'*')
+                    {
+                        cursor.advance();
+                        open_comment = true;
+                    }
+                }
+                previous = c;
+            }
+        }
+
+        // Return whether a block comment is left open at the end of a logical line of a listing,
+        // given whether one is open at its start.
+        bool comment_open_after(const SourceListing& listing, LineDescriptor x, bool open_comment)
+        {
+            // Most lines do not hold the first character of a comment delimiter at all.
+            if (x.sort() == LineSort::Simple)
+            {
+                const auto text = listing.contents(listing.simple_line(x).line.isle, listing.line_depot());
+                if (std::ranges::find(text, open_comment ? u8'*' : u8'/') == text.end())
+                    return open_comment;
+            }
+            on_line(listing, x, [&](auto cursor) { track_comments(cursor, open_comment); });
+            return open_comment;
+        }
+
+        // This predicate holds if a logical line of the given species is a directive.
+        constexpr bool directive(LineSpecies s)
+        {
+            return s != LineSpecies::Unknown and s != LineSpecies::Text;
+        }
+    }
+
+    ConditionalStructure::ConditionalStructure(const SourceListing& listing)
+    {
+        const auto& lines = listing.logical_lines();
+        if (lines.size() >= std::numeric_limits<std::uint32_t>::max())
+            throw std::length_error{"too many logical lines for a conditional structure"};
+        const auto size = static_cast<std::uint32_t>(lines.size());
+        links.resize(size);
+
+        // A conditional being processed: its opening directive, its last directive so far, and
+        // whether an `#else` was seen.
+        struct Opening {
+            std::uint32_t first;
+            std::uint32_t last;
+            bool otherwise;
+        };
+        std::vector<Opening> openings;
+
+        // Set the end of all directives of the innermost conditional, and close it.
+        const auto close = [&](std::uint32_t end) {
+            auto& opening = openings.back();
+            links[opening.last].next = end;
+            for (auto i = opening.first; i != end; i = links[i].next)
+                links[i].end = end;
+            openings.pop_back();
+        };
+        const auto report = [&](Defect d, std::uint32_t i) {
+            defects.push_back({ d, line_number(listing, lines[i]) });
+        };
+
+        bool open_comment = false;
+        for (std::uint32_t i = 0; i < size; ++i)
+        {
+            links[i] = { i, i };
+            // A directive-like line starting within a block comment is no directive.
+            const bool commented = open_comment;
+            open_comment = comment_open_after(listing, lines[i], open_comment);
+            if (commented and directive(lines[i].species()))
+            {
+                comments.push_back(i);
+                continue;
+            }
+            switch (lines[i].species())
+            {
+            case LineSpecies::If:
+            case LineSpecies::Ifdef:
+            case LineSpecies::Ifndef:
+                openings.push_back({ i, i, false });
+                break;
+
+            case LineSpecies::Elif:
+            case LineSpecies::Elifdef:
+            case LineSpecies::Elifndef:
+            case LineSpecies::Else:
+                if (openings.empty())
+                    report(Defect::UnmatchedElse, i);
+                else
+                {
+                    auto& opening = openings.back();
+                    if (opening.otherwise)
+                        report(lines[i].species() == LineSpecies::Else ? Defect::DuplicateElse : Defect::ElifAfterElse, i);
+                    opening.otherwise = opening.otherwise or lines[i].species() == LineSpecies::Else;
+                    links[opening.last].next = i;
+                    opening.last = i;
+                }
+                break;
+
+            case LineSpecies::Endif:
+                if (openings.empty())
+                    report(Defect::UnmatchedEndif, i);
+                else
+                    close(i);
+                break;
+
+            default:
+                break;
+            }
+        }
+
+        while (not openings.empty())
+        {
+            report(Defect::UnterminatedIf, openings.back().first);
+            close(size);
+        }
+        std::ranges::sort(defects, { }, &Malformation::line);
+    }
+
+    bool ConditionalStructure::commented(std::size_t n) const
+    {
+        return std::ranges::binary_search(comments, n);
+    }
+
+    namespace {
+        // This predicate holds if the characters delivered by the cursor are only blanks and comments.
+        // The argument bound to `open_comment` indicates whether a block comment left open by a previous
+        // line is continued; on return, it indicates whether a block comment is left open.
+        template<typename Cursor>
+        bool blank_or_comment(Cursor cursor, bool& open_comment)
+        {
+            while (not cursor.done())
+            {
+                if (open_comment)
+                {
+                    const auto c = *cursor;
+                    cursor.advance();
+                    if (c == u8'*' and not cursor.done() and *cursor == u8'/')
+                    {
+                        cursor.advance();
+                        open_comment = false;
+                    }
+                }
+                else if (white_space(*cursor))
+                    cursor.advance();
+                else if (*cursor != u8'/')
+                    return false;
+                else
+                {
+                    cursor.advance();
+                    if (cursor.done() or (*cursor != u8'/' and *cursor != u8'*'))
+                        return false;
+                    else if (*cursor == u8'/')
+                        return true;
+                    cursor.advance();
+                    open_comment = true;
+                }
+            }
+            return true;
+        }
+
+        // This predicate holds if the characters delivered by the cursor, not continuing a block
+        // comment, are only blanks and complete comments.
+        template<typename Cursor>
+        bool blank_or_comment(Cursor cursor)
+        {
+            bool open_comment = false;
+            return blank_or_comment(cursor, open_comment) and not open_comment;
+        }
+
+        // Advance the cursor past the `#` and the name of the directive it delivers.
+        template<typename Cursor>
+        void skip_directive_name(Cursor& cursor)
+        {
+            char8_t buffer[max_directive_length];
+            skip_blank(cursor);
+            cursor.advance();
+            skip_blank(cursor);
+            gather_name(cursor, buffer);
+            skip_blank(cursor);
+        }
+
+        // Return the macro name operand of a directive of species `s` that may belong to an include
+        // guard: `#ifndef X`, `#if !defined X`, `#if !defined(X)`, or `#define X ...`.  Return an
+        // empty string if the directive is of none of these forms.
+        template<typename Cursor>
+        std::u8string guard_operand(Cursor cursor, LineSpecies s)
+        {
+            skip_directive_name(cursor);
+            bool parenthesized = false;
+            if (s == LineSpecies::If)
+            {
+                if (cursor.done() or *cursor != u8'!')
+                    return { };
+                cursor.advance();
+                skip_blank(cursor);
+                char8_t buffer[8];
+                if (gather_name(cursor, buffer) != u8"defined")
+                    return { };
+                skip_blank(cursor);
+                parenthesized = not cursor.done() and *cursor == u8'(';
+                if (parenthesized)
+                {
+                    cursor.advance();
+                    skip_blank(cursor);
+                }
+            }
+
+            std::u8string name;
+            for (; not cursor.done() and narrow_letter_or_digit(*cursor); cursor.advance())
+                name += *cursor;
+            if (name.empty() or (name.front() >= u8'0' and name.front() <= u8'9'))
+                return { };
+            if (s == LineSpecies::Define)
+            {
+                // The replacement list is immaterial, but the name shall not continue past narrow characters.
+                if (cursor.done() or white_space(*cursor) or *cursor == u8'(' or *cursor == u8'/')
+                    return name;
+                return { };
+            }
+            skip_blank(cursor);
+            if (parenthesized)
+            {
+                if (cursor.done() or *cursor != u8')')
+                    return { };
+                cursor.advance();
+            }
+            return blank_or_comment(cursor) ? name : std::u8string{ };
+        }
+
+        // This predicate holds if the `#pragma` directive delivered by the cursor is `#pragma once`.
+        template<typename Cursor>
+        bool pragma_once(Cursor cursor)
+        {
+            char8_t buffer[5];
+            skip_directive_name(cursor);
+            return gather_name(cursor, buffer) == u8"once" and blank_or_comment(cursor);
+        }
+    }
+
+    InclusionGuard inclusion_guard(const SourceListing& listing)
+    {
+        InclusionGuard guard;
+        const auto& lines = listing.logical_lines();
+        const ConditionalStructure structure { listing };
+
+        // Return the position of the first line, from the n-th, not made only of blanks and comments.
+        bool open_comment = false;
+        const auto significant = [&](std::size_t n) {
+            for (; n < lines.size(); ++n)
+            {
+                const auto s = lines[n].species();
+                if (s == LineSpecies::Unknown and not open_comment)
+                    continue;
+                if (s != LineSpecies::Text and s != LineSpecies::Unknown)
+                    break;
+                if (not on_line(listing, lines[n], [&](auto cursor) { return blank_or_comment(cursor, open_comment); }))
+                    break;
+            }
+            return n;
+        };
+
+        // A directive within a block comment is not a directive; bail out on any doubt.
+        const auto opening = significant(0);
+        if (opening < lines.size() and not open_comment)
+        {
+            const auto s = lines[opening].species();
+            const auto end = structure.endif(opening);
+            std::u8string macro;
+            if ((s == LineSpecies::Ifndef or s == LineSpecies::If) and end < lines.size()
+                and structure.next_group(opening) == end)
+                macro = on_line(listing, lines[opening], [s](auto cursor) { return guard_operand(cursor, s); });
+            const auto definition = significant(opening + 1);
+            if (not macro.empty() and definition < end and not open_comment
+                and lines[definition].species() == LineSpecies::Define
+                and on_line(listing, lines[definition], [](auto cursor) { return guard_operand(cursor, LineSpecies::Define); }) == macro)
+            {
+                open_comment = comment_open_after(listing, lines[end], false);
+                if (significant(end + 1) == lines.size() and not open_comment)
+                    guard.macro = std::move(macro);
+            }
+        }
+
+        // Only a `#pragma once` not subject to conditional inclusion, except by the include guard, is effective.
+        std::size_t depth = 0;
+        for (std::size_t i = 0; i < lines.size() and not guard.pragma_once; ++i)
+        {
+            if (structure.commented(i))
+                continue;
+            switch (lines[i].species())
+            {
+            case LineSpecies::If:
+            case LineSpecies::Ifdef:
+            case LineSpecies::Ifndef:
+                ++depth;
+                break;
+            case LineSpecies::Endif:
+                depth -= depth > 0;
+                break;
+            case LineSpecies::Pragma:
+                if (depth == 0 or (depth == 1 and not guard.macro.empty() and i < structure.endif(opening)))
+                    guard.pragma_once = on_line(listing, lines[i], [](auto cursor) { return pragma_once(cursor); });
+                break;
+            default:
+                break;
+            }
+        }
+        return guard;
+    }
+
+    namespace {
+        // Cursor over the characters of a logical line, recording the extent in the source text of
+        // the characters consumed since the start of the current token.
+        template<typename Cursor>
+        struct TokenCursor {
+            explicit TokenCursor(Cursor c) : cursor{c} { }
+            bool done() const { return cursor.done(); }
+            char8_t operator*() const { return *cursor; }
+            void advance()
+            {
+                end = cursor.where() + 1;
+                ++count;
+                cursor.advance();
+            }
+            void start_token()
+            {
+                start = end = cursor.where();
+                count = 0;
+            }
+            // This predicate holds if the current token straddles physical lines.
+            bool spliced() const { return static_cast<std::size_t>(end - start) != count; }
+            // Return the character `n` positions ahead of the cursor, or 0 past the end of the line.
+            char8_t peek(std::size_t n) const
+            {
+                auto c = cursor;
+                for (; n > 0 and not c.done(); --n)
+                    c.advance();
+                return c.done() ? 0 : *c;
+            }
+
+            Cursor cursor;
+            const char8_t* start = nullptr;
+            const char8_t* end = nullptr;
+            std::size_t count = 0;
+        };
+
+        inline bool identifier_continue(char8_t c)
+        {
+            return narrow_letter_or_digit(c) or c >= 0x80;
+        }
+
+        inline bool decimal_digit(char8_t c)
+        {
+            return c >= u8'0' and c <= u8'9';
+        }
+
+        // Multi-character preprocessing operators and punctuators, longest first.
+        constexpr std::u8string_view compound_punctuators[] {
+            u8"%:%:", u8"...", u8"<=>", u8"<<=", u8">>=", u8"->*",
+            u8"##", u8"::", u8".*", u8"->", u8"++", u8"--", u8"<<", u8">>", u8"<=", u8">=",
+            u8"==", u8"!=", u8"&&", u8"||", u8"+=", u8"-=", u8"*=", u8"/=", u8"%=", u8"&=",
+            u8"|=", u8"^=", u8"<:", u8":>", u8"<%", u8"%>", u8"%:",
+        };
+
+        // Single-character preprocessing operators and punctuators.
+        constexpr std::u8string_view simple_punctuators = u8"{}[]#()<>%:;.?*+-/^&|~!=,";
+
+        // Consume the rest of a character or string literal, from its opening quote.
+        template<typename Cursor>
+        TokenKind quoted_literal(TokenCursor<Cursor>& c)
+        {
+            const auto quote = *c;
+            for (c.advance(); not c.done(); )
+            {
+                const auto x = *c;
+                c.advance();
+                if (x == quote)
+                    return quote == u8'"' ? TokenKind::String : TokenKind::Character;
+                else if (x == u8'\\' and not c.done())
+                    c.advance();
+            }
+            return TokenKind::Other;
+        }
+
+        // Consume the rest of a raw string literal, from its opening quote.
+        template<typename Cursor>
+        TokenKind raw_literal(TokenCursor<Cursor>& c)
+        {
+            std::u8string closing = u8")";
+            for (c.advance(); not c.done() and *c != u8'('; c.advance())
+                closing += *c;
+            closing += u8'"';
+            if (c.done())
+                return TokenKind::Other;
+            // A delimiter has no parenthesis; a mismatch restarts the matching at a `)`.
+            std::size_t matched = 0;
+            for (c.advance(); not c.done(); )
+            {
+                const auto x = *c;
+                c.advance();
+                if (x == closing[matched])
+                {
+                    if (++matched == closing.size())
+                        return TokenKind::String;
+                }
+                else
+                    matched = x == u8')';
+            }
+            return TokenKind::Other;
+        }
+
+        // Consume the preprocessing token starting at the cursor, and return its kind.  A header-name
+        // is recognized only if `header_name` holds.
+        template<typename Cursor>
+        TokenKind lex_token(TokenCursor<Cursor>& c, bool header_name)
+        {
+            const auto ch = *c;
+            if (header_name and (ch == u8'<' or ch == u8'"'))
+            {
+                const auto closing = ch == u8'<' ? u8'>' : u8'"';
+                auto probe = c.cursor;
+                std::size_t n = 1;
+                for (probe.advance(); not probe.done() and *probe != closing; probe.advance())
+                    ++n;
+                if (not probe.done())
+                {
+                    for (++n; n > 0; --n)
+                        c.advance();
+                    return TokenKind::HeaderName;
+                }
+            }
+
+            if (identifier_continue(ch) and not decimal_digit(ch))
+            {
+                // Gather the spelling of short identifiers, which may be encoding prefixes.
+                char8_t prefix[4];
+                std::size_t length = 0;
+                for (; not c.done() and identifier_continue(*c); c.advance())
+                {
+                    if (length < std::size(prefix))
+                        prefix[length] = *c;
+                    ++length;
+                }
+                if (c.done() or length > 3 or (*c != u8'"' and *c != u8'\''))
+                    return TokenKind::Identifier;
+                const std::u8string_view spelling { prefix, length };
+                if (*c == u8'"' and (spelling == u8"R" or spelling == u8"u8R" or spelling == u8"uR"
+                                     or spelling == u8"UR" or spelling == u8"LR"))
+                    return raw_literal(c);
+                if (spelling == u8"u8" or spelling == u8"u" or spelling == u8"U" or spelling == u8"L")
+                    return quoted_literal(c);
+                return TokenKind::Identifier;
+            }
+
+            if (decimal_digit(ch) or (ch == u8'.' and decimal_digit(c.peek(1))))
+            {
+                for (c.advance(); not c.done(); )
+                {
+                    const auto x = *c;
+                    const auto next = c.peek(1);
+                    if ((x == u8'e' or x == u8'E' or x == u8'p' or x == u8'P') and (next == u8'+' or next == u8'-'))
+                    {
+                        c.advance();
+                        c.advance();
+                    }
+                    else if (x == u8'\'' and identifier_continue(next))
+                    {
+                        c.advance();
+                        c.advance();
+                    }
+                    else if (identifier_continue(x) or x == u8'.')
+                        c.advance();
+                    else
+                        break;
+                }
+                return TokenKind::Number;
+            }
+
+            if (ch == u8'"' or ch == u8'\'')
+                return quoted_literal(c);
+
+            char8_t ahead[4] { ch, c.peek(1), c.peek(2), c.peek(3) };
+            const std::u8string_view lookahead { ahead, std::size(ahead) };
+            for (auto p : compound_punctuators)
+            {
+                if (lookahead.starts_with(p))
+                {
+                    for (std::size_t n = p.size(); n > 0; --n)
+                        c.advance();
+                    return TokenKind::Punctuator;
+                }
+            }
+            c.advance();
+            return simple_punctuators.contains(ch) ? TokenKind::Punctuator : TokenKind::Other;
+        }
+
+        // Advance the cursor past blanks and comments.  A block comment left open ends the line.
+        template<typename Cursor>
+        void skip_blanks_and_comments(TokenCursor<Cursor>& c)
+        {
+            while (not c.done())
+            {
+                if (white_space(*c))
+                    c.advance();
+                else if (*c != u8'/' or (c.peek(1) != u8'/' and c.peek(1) != u8'*'))
+                    return;
+                else if (c.peek(1) == u8'/')
+                {
+                    while (not c.done())
+                        c.advance();
+                }
+                else
+                {
+                    c.advance();
+                    c.advance();
+                    while (not c.done() and not (*c == u8'*' and c.peek(1) == u8'/'))
+                        c.advance();
+                    if (not c.done())
+                    {
+                        c.advance();
+                        c.advance();
+                    }
+                }
+            }
+        }
+
+        // Names of the directives and module declarations taking a header-name operand.
+        inline bool header_name_introducer(std::u8string_view s)
+        {
+            return s == u8"include" or s == u8"import" or s == u8"embed" or s == u8"include_next";
+        }
+
+        // Call `emit` with the kind, the start, the end, and whether spliced, of each preprocessing
+        // token of the logical line delivered by the cursor.
+        template<typename Cursor, typename F>
+        void tokenize_line(Cursor line, F emit)
+        {
+            TokenCursor<Cursor> c { line };
+            bool header_name = false;
+            for (std::size_t count = 0; ; ++count)
+            {
+                skip_blanks_and_comments(c);
+                if (c.done())
+                    return;
+                c.start_token();
+                const auto kind = lex_token(c, header_name);
+                emit(kind, c.start, c.end, c.spliced());
+                // A header-name follows `#include`, `import`, or `export import`.
+                header_name = count < 2 and kind == TokenKind::Identifier and not c.spliced()
+                    and header_name_introducer({ c.start, static_cast<std::size_t>(c.end - c.start) });
+            }
+        }
+    }
+
+    DirectiveTokens::DirectiveTokens(const SourceListing& listing)
+    {
+        const auto& lines = listing.logical_lines();
+        const auto text = listing.contents().data();
+        starts.reserve(lines.size() + 1);
+        for (std::size_t n = 0; n < lines.size(); ++n)
+        {
+            starts.push_back(static_cast<std::uint32_t>(token_kinds.size()));
+            const auto s = lines[n].species();
+            if (s == LineSpecies::Unknown or s == LineSpecies::Text)
+                continue;
+            on_line(listing, lines[n], [&](auto cursor) {
+                tokenize_line(cursor, [&](TokenKind k, const char8_t* start, const char8_t* end, bool spliced) {
+                    if (token_kinds.size() >= std::numeric_limits<std::uint32_t>::max())
+                        throw std::length_error{"too many directive tokens"};
+                    if (spliced)
+                        spliced_tokens.push_back(static_cast<std::uint32_t>(token_kinds.size()));
+                    token_kinds.push_back(k);
+                    token_offsets.push_back(start - text);
+                    token_lengths.push_back(static_cast<std::uint32_t>(std::min<std::uint64_t>(end - start, std::numeric_limits<std::uint32_t>::max())));
+                });
+            });
+        }
+        starts.push_back(static_cast<std::uint32_t>(token_kinds.size()));
+    }
+
+    bool DirectiveTokens::spliced(std::size_t t) const
+    {
+        return std::ranges::binary_search(spliced_tokens, t);
     }
-}
\ No newline at end of file
+}
@@ -0,0 +1,69 @@
+#include "doctest/doctest.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <string>
+#include "ipr/input"
+
+// Count the dynamic allocations made by the whole program.  This file is built into an
+// executable of its own, so that the replacement allocation functions affect no other benchmark.
+namespace {
+    std::atomic<std::uint64_t> allocation_count { };
+}
+
+void* operator new(std::size_t n)
+{
+    ++allocation_count;
+    if (auto p = std::malloc(n == 0 ? 1 : n))
+        return p;
+    throw std::bad_alloc{ };
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+
+namespace {
+    // Synthesize a macro-dense header of about `size` bytes, in the style of
+    // configuration and code generation headers.
+    std::string synthesize_macros(std::size_t size)
+    {
+        std::string text;
+        for (int i = 0; text.size() < size; ++i)
+        {
+            const auto n = std::to_string(i);
+            text += "#define DECLARE_ACCESSORS_" + n + "(type, name)      \\\n"
+                    "    type get_##name() const { return name; }    \\\n"
+                    "    void set_##name(type v) { name = v; }       \\\n"
+                    "    type name\n";
+            text += "#  if defined(FEATURE_" + n + ") && \\\n      FEATURE_" + n + " > 1\n";
+            text += "DECLARE_ACCESSORS_" + n + "(int, field_" + n + ");\n";
+            text += "#  endif\n";
+        }
+        return text;
+    }
+}
+
+TEST_CASE("composite line classification") {
+    const auto path = std::filesystem::temp_directory_path() / "ipr-bench-macros.h";
+    std::ofstream{path, std::ios::binary} << synthesize_macros(std::size_t{32} << 20);
+
+    const auto before = allocation_count.load();
+    const auto start = std::chrono::steady_clock::now();
+    ipr::input::SourceListing listing{path.native()};
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    const auto allocations = allocation_count.load() - before;
+
+    std::uint64_t composites = 0;
+    for (auto line : listing.logical_lines())
+        composites += line.sort() == ipr::input::LineSort::Composite;
+    std::cout << "composite lines: " << composites
+              << ", allocations per composite line: " << double(allocations) / composites
+              << ", listing " << listing.contents().size() / 1e6 / elapsed.count() << " MB/s\n";
+    CHECK(composites > 0);
+    std::filesystem::remove(path);
+}
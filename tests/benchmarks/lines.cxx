@@ -0,0 +1,400 @@
+#include "doctest/doctest.h"
+
+#ifndef _WIN32
+#  include <fcntl.h>
+#  include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "ipr/input"
+
+namespace {
+    // Synthesize a generated-header like text of about `size` bytes.
+    std::string synthesize_header(std::size_t size, bool data_tables)
+    {
+        if (data_tables)
+        {
+            std::string row = "    ";
+            for (int i = 0; i < 160; ++i)
+                row += "0x" + std::to_string(1000 + i) + ", ";
+            row += '\n';
+            std::string text;
+            while (text.size() < size)
+                text += row;
+            return text;
+        }
+
+        const char* samples[] {
+            "#ifndef GENERATED_HEADER_H\n",
+            "#define GENERATED_TABLE_ENTRY(name, value) { #name, value },\n",
+            "namespace generated {\n",
+            "    struct Record { int field; const char* name; unsigned long long mask; };\n",
+            "        GENERATED_TABLE_ENTRY(alpha_beta_gamma_delta, 0x0123456789abcdefULL)\n",
+            "\n",
+            "    // A comment line of moderate length, as commonly emitted by code generators.\n",
+            "            constexpr auto value_42 = compute<42>(std::integral_constant<int, 42>{ });\r\n",
+            "}\n",
+            "#endif\n",
+        };
+        std::string text;
+        text.reserve(size + 128);
+        for (std::size_t i = 0; text.size() < size; ++i)
+            text += samples[i * 7 % std::size(samples)];
+        return text;
+    }
+
+    // Return the best time, in seconds, of a few runs of the argument.
+    template<typename F>
+    double best_of(int runs, F f)
+    {
+        double best = 1e30;
+        for (int i = 0; i < runs; ++i)
+        {
+            const auto start = std::chrono::steady_clock::now();
+            f();
+            const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            best = std::min(best, elapsed.count());
+        }
+        return best;
+    }
+
+    // Evict the contents of the designated files from the page cache, where supported,
+    // to measure cold-start loading without privileges to drop all caches.
+    void evict_from_page_cache(const std::vector<ipr::input::SystemPath>& paths)
+    {
+#ifndef _WIN32
+        for (auto& path : paths)
+        {
+            auto fd = open(path.c_str(), O_RDONLY);
+            if (fd < 0)
+                continue;
+            fdatasync(fd);
+            posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+            close(fd);
+        }
+#endif
+    }
+
+    const char* kernel_name(ipr::input::ScanKernel k)
+    {
+        switch (k)
+        {
+        case ipr::input::ScanKernel::SSE2: return "SSE2";
+        case ipr::input::ScanKernel::AVX2: return "AVX2";
+        default: return "Scalar";
+        }
+    }
+}
+
+TEST_CASE("line scanning throughput") {
+    const auto path = std::filesystem::temp_directory_path() / "ipr-bench-lines.h";
+    const auto initial = ipr::input::scan_kernel();
+    for (bool tables : { false, true })
+    {
+        std::ofstream{path, std::ios::binary} << synthesize_header(std::size_t{64} << 20, tables);
+        std::cout << (tables ? "data tables" : "declarations") << ":\n";
+        for (auto k : { ipr::input::ScanKernel::Scalar, ipr::input::ScanKernel::SSE2, ipr::input::ScanKernel::AVX2 })
+        {
+            if (ipr::input::use_scan_kernel(k) != k)
+                continue;
+            ipr::input::SourceFile file{path.native()};
+            const double megabytes = file.contents().size() / 1e6;
+            std::uint64_t count = 0;
+            auto scan = best_of(5, [&] {
+                count = 0;
+                for (auto line : file.lines())
+                    count += line.indent != 0;
+            });
+            auto listing = best_of(3, [&] { ipr::input::SourceListing { path.native() }; });
+            std::cout << "  " << kernel_name(k) << ": physical lines " << megabytes / scan << " MB/s, "
+                      << "listing " << megabytes / listing << " MB/s\n";
+            CHECK(count > 0);
+        }
+    }
+    ipr::input::use_scan_kernel(initial);
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("parallel listing throughput") {
+    const auto path = std::filesystem::temp_directory_path() / "ipr-bench-amalgamation.cxx";
+    std::ofstream{path, std::ios::binary} << synthesize_header(std::size_t{64} << 20, false);
+    const double megabytes = std::filesystem::file_size(path) / 1e6;
+    for (unsigned threads : { 1u, 2u, 4u, 8u, 0u })
+    {
+        auto elapsed = best_of(3, [&] { ipr::input::SourceListing { path.native(), { .threads = threads } }; });
+        std::cout << "threads " << threads << ": listing " << megabytes / elapsed << " MB/s\n";
+    }
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("cached listing throughput") {
+    const auto path = std::filesystem::temp_directory_path() / "ipr-bench-cached.h";
+    const auto dir = std::filesystem::temp_directory_path() / "ipr-bench-cache";
+    std::ofstream{path, std::ios::binary} << synthesize_header(std::size_t{64} << 20, false);
+    const double megabytes = std::filesystem::file_size(path) / 1e6;
+    ipr::input::ListingCache cache{dir.native()};
+    auto cold = best_of(1, [&] { ipr::input::SourceListing { path.native(), { .cache = &cache } }; });
+    // A file modified just now is hashed on every hit; one modified long ago is vouched for by
+    // its modification time once its entry records it.
+    auto hashed = best_of(3, [&] { ipr::input::SourceListing { path.native(), { .cache = &cache } }; });
+    std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now() - std::chrono::hours{1});
+    ipr::input::SourceListing { path.native(), { .cache = &cache } };
+    auto vouched = best_of(3, [&] { ipr::input::SourceListing { path.native(), { .cache = &cache } }; });
+    auto stats = cache.statistics();
+    std::cout << "cache miss: " << megabytes / cold << " MB/s, cache hit: " << megabytes / hashed << " MB/s hashed, "
+              << megabytes / vouched << " MB/s vouched by modification time"
+              << " (" << stats.hits << " hits, " << stats.misses << " misses)\n";
+    CHECK(stats.hits == 7);
+    std::filesystem::remove(path);
+    std::filesystem::remove_all(dir);
+}
+
+TEST_CASE("dependency scanning throughput") {
+    // A tree of small translation units, each with a handful of dependency lines.
+    const auto dir = std::filesystem::temp_directory_path() / "ipr-bench-deps";
+    std::filesystem::create_directories(dir);
+    const auto body = synthesize_header(8 << 10, false);
+    std::vector<ipr::input::SystemPath> paths;
+    for (int i = 0; i < 4000; ++i)
+    {
+        auto path = dir / ("unit" + std::to_string(i) + ".cxx");
+        std::ofstream{path, std::ios::binary}
+            << "module;\n#include <vector>\n#include \"unit" << i / 2 << ".h\"\n"
+            << "export module unit" << i << ";\nimport std;\nimport unit" << i / 3 << ";\n"
+            << body;
+        paths.push_back(path.native());
+    }
+
+    for (unsigned threads : { 1u, 0u })
+    {
+        std::size_t count = 0;
+        auto t = best_of(3, [&] {
+            count = 0;
+            for (auto& record : ipr::input::scan_dependencies(paths, threads))
+                count += record.dependencies.size();
+        });
+        std::cout << "dependency scan, " << (threads == 0 ? "all threads" : "1 thread") << ": "
+                  << paths.size() / t << " files/s\n";
+        CHECK(count == paths.size() * 5);
+    }
+    std::filesystem::remove_all(dir);
+}
+
+TEST_CASE("source set loading throughput") {
+    // An include tree of mostly small headers, with a few large ones.
+    const auto dir = std::filesystem::temp_directory_path() / "ipr-bench-set";
+    std::filesystem::create_directories(dir);
+    std::vector<ipr::input::SystemPath> paths;
+    for (int i = 0; i < 4000; ++i)
+    {
+        auto path = dir / ("header" + std::to_string(i) + ".h");
+        std::ofstream{path, std::ios::binary} << synthesize_header(i % 100 == 0 ? 1 << 20 : 2 << 10, false);
+        paths.push_back(path.native());
+    }
+
+    std::size_t lines = 0;
+    auto single = best_of(3, [&] {
+        lines = 0;
+        for (auto& path : paths)
+            lines += ipr::input::SourceListing{path}.logical_lines().size();
+    });
+    for (unsigned threads : { 1u, 0u })
+    {
+        std::size_t count = 0;
+        auto t = best_of(3, [&] {
+            count = 0;
+            ipr::input::SourceSet set{paths, { .threads = threads }};
+            for (std::size_t i = 0; i < set.size(); ++i)
+                count += set.listing(i).logical_lines().size();
+        });
+        std::cout << "file by file: " << paths.size() / single << " files/s, source set ("
+                  << (threads == 0 ? "all threads" : "1 thread") << "): " << paths.size() / t << " files/s\n";
+        CHECK(count == lines);
+    }
+    std::filesystem::remove_all(dir);
+}
+
+TEST_CASE("cold source set loading") {
+    const auto dir = std::filesystem::temp_directory_path() / "ipr-bench-cold";
+    std::filesystem::create_directories(dir);
+    std::vector<ipr::input::SystemPath> paths;
+    for (int i = 0; i < 4000; ++i)
+    {
+        auto path = dir / ("header" + std::to_string(i) + ".h");
+        std::ofstream{path, std::ios::binary} << synthesize_header(i % 100 == 0 ? 1 << 20 : 8 << 10, false);
+        paths.push_back(path.native());
+    }
+
+    for (auto backend : { ipr::input::LoadBackend::Mapped, ipr::input::LoadBackend::Ring })
+    {
+        std::size_t lines = 0;
+        auto effective = backend;
+        const auto handler = [&](const ipr::input::SourceSet& set, std::size_t n) {
+            lines += set.listing(n).logical_lines().size();
+        };
+        double t = 1e30;
+        for (int run = 0; run < 3; ++run)
+        {
+            evict_from_page_cache(paths);
+            lines = 0;
+            t = std::min(t, best_of(1, [&] {
+                ipr::input::SourceSet set{paths, { .backend = backend }, handler};
+                effective = set.backend();
+            }));
+        }
+        std::cout << "cold start, " << (effective == ipr::input::LoadBackend::Ring ? "io_uring" : "mapped")
+                  << " backend: " << paths.size() / t << " files/s\n";
+        CHECK(lines > 0);
+    }
+    std::filesystem::remove_all(dir);
+}
+
+TEST_CASE("long line listing throughput") {
+    // Ordinary lines take the compact path; minified lines, of 1 MiB each, overflow the isle length.
+    const auto path = std::filesystem::temp_directory_path() / "ipr-bench-long.h";
+    for (bool minified : { false, true })
+    {
+        auto text = synthesize_header(std::size_t{64} << 20, minified);
+        if (minified)
+        {
+            std::erase(text, '\n');
+            for (std::size_t i = 1 << 20; i < text.size(); i += 1 << 20)
+                text[i] = '\n';
+        }
+        std::ofstream{path, std::ios::binary} << text;
+        const double megabytes = text.size() / 1e6;
+        std::size_t long_isles = 0;
+        auto t = best_of(5, [&] {
+            ipr::input::SourceListing listing{path.native()};
+            long_isles = listing.line_depot().long_isles.size();
+        });
+        std::cout << (minified ? "minified" : "ordinary") << " lines: listing " << megabytes / t << " MB/s, "
+                  << long_isles << " long isles\n";
+        CHECK((long_isles != 0) == minified);
+    }
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("position lookup throughput") {
+    const auto path = std::filesystem::temp_directory_path() / "ipr-bench-positions.h";
+    std::ofstream{path, std::ios::binary} << synthesize_header(std::size_t{64} << 20, false);
+    ipr::input::SourceListing listing{path.native()};
+    const auto size = listing.contents().size();
+
+    auto build = best_of(1, [&] { listing.position(0); });
+    std::vector<std::uint64_t> offsets;
+    std::uint64_t seed = 7;
+    for (int i = 0; i < 1000000; ++i)
+    {
+        seed = seed * 6364136223846793005 + 1442695040888963407;
+        offsets.push_back((seed >> 11) % size);
+    }
+    std::cout << "line index built in " << build * 1e3 << " ms\n";
+
+    const auto initial = ipr::input::scan_kernel();
+    for (auto k : { ipr::input::ScanKernel::Scalar, ipr::input::ScanKernel::SSE2, ipr::input::ScanKernel::AVX2 })
+    {
+        if (ipr::input::use_scan_kernel(k) != k)
+            continue;
+        std::uint64_t sum = 0;
+        auto t = best_of(3, [&] {
+            for (auto x : offsets)
+            {
+                auto p = listing.position(x);
+                sum += p.line + p.column;
+            }
+        });
+        std::cout << kernel_name(k) << ": " << offsets.size() / t / 1e6 << " million lookups/s\n";
+        CHECK(sum != 0);
+    }
+    ipr::input::use_scan_kernel(initial);
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("UTF-8 validation throughput") {
+    const auto path = std::filesystem::temp_directory_path() / "ipr-bench-utf8.h";
+    const auto initial = ipr::input::scan_kernel();
+    for (bool ascii : { true, false })
+    {
+        std::string text = synthesize_header(std::size_t{64} << 20, false);
+        if (not ascii)
+        {
+            // Sprinkle comments written in assorted scripts.
+            std::string comment = "    // \xCE\xBB\xCF\x80\xCF\x81 \xE6\xBC\xA2\xE5\xAD\x97 \xD0\xB6\xD0\xB8 \xF0\x9F\x98\x80 caf\xC3\xA9\n";
+            std::string mixed;
+            std::size_t start = 0;
+            for (std::size_t pos = 0; (pos = text.find('\n', pos + 200)) != std::string::npos; start = ++pos)
+                mixed.append(text, start, pos + 1 - start).append(comment);
+            text = std::move(mixed.append(text, start));
+        }
+        std::ofstream{path, std::ios::binary} << text;
+        std::cout << (ascii ? "ASCII" : "mixed scripts") << ":\n";
+        for (auto k : { ipr::input::ScanKernel::Scalar, ipr::input::ScanKernel::SSE2, ipr::input::ScanKernel::AVX2 })
+        {
+            if (ipr::input::use_scan_kernel(k) != k)
+                continue;
+            ipr::input::SourceFile file{path.native()};
+            const double megabytes = file.contents().size() / 1e6;
+            std::uint64_t invalid = 0;
+            auto validate = best_of(5, [&] { invalid = ipr::input::first_invalid_utf8(file.contents()); });
+            auto plain = best_of(3, [&] { ipr::input::SourceListing { path.native() }; });
+            auto checked = best_of(3, [&] { ipr::input::SourceListing { path.native(), { .validate_utf8 = true } }; });
+            std::cout << "  " << kernel_name(k) << ": validation " << megabytes / validate << " MB/s, "
+                      << "listing " << megabytes / plain << " MB/s, validated listing " << megabytes / checked << " MB/s\n";
+            CHECK(invalid == file.contents().size());
+        }
+    }
+    ipr::input::use_scan_kernel(initial);
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("directive classification throughput") {
+    // A mix of directives and text lines in the proportions of a system header, held in memory.
+    const char* samples[] {
+        "#include <bits/c++config.h>\n",
+        "#if __cplusplus >= 201103L\n",
+        "  template<typename _Tp> struct remove_const { typedef _Tp type; };\n",
+        "#ifdef _GLIBCXX_USE_WCHAR_T\n",
+        "# define _GLIBCXX_HAVE_WCHAR 1\n",
+        "#else\n",
+        "  // Fall back to the narrow character facilities.\n",
+        "#endif\n",
+        "#  pragma GCC system_header\n",
+        "#ifndef _GLIBCXX_NOEXCEPT\n",
+        "    static constexpr bool value = __is_trivially_copyable(_Tp);\n",
+        "#elif defined(__clang__)\n",
+        "#undef _GLIBCXX_NOEXCEPT\n",
+        "import std;\n",
+        "#line 42 \"generated.h\"\n",
+        "#error unsupported configuration\n",
+        "#warning deprecated header\n",
+        "#embed \"data.bin\"\n",
+        "#elifdef __GNUC__\n",
+        "#ident \"extension\"\n",
+        "\n",
+    };
+    std::string text;
+    for (std::size_t i = 0; text.size() < (std::size_t{32} << 20); ++i)
+        text += samples[i * 7 % std::size(samples)];
+    // The same lines, none of which is a directive, to set apart the cost of line scanning.
+    std::string plain = text;
+    std::ranges::replace(plain, '#', '$');
+
+    const std::u8string_view directives { reinterpret_cast<const char8_t*>(text.data()), text.size() };
+    const std::u8string_view others { reinterpret_cast<const char8_t*>(plain.data()), plain.size() };
+    std::size_t lines = 0;
+    auto classified = best_of(5, [&] {
+        lines = ipr::input::SourceListing{ipr::input::SourceFile{directives}}.logical_lines().size();
+    });
+    auto unclassified = best_of(5, [&] { ipr::input::SourceListing{ipr::input::SourceFile{others}}; });
+    std::cout << "directive lines: " << lines / classified / 1e6 << " M lines/s, "
+              << "non-directive lines: " << lines / unclassified / 1e6 << " M lines/s, "
+              << "classification " << (classified - unclassified) / lines * 1e9 << " ns per line\n";
+    CHECK(lines > 0);
+}
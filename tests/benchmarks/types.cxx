@@ -0,0 +1,40 @@
+#include "doctest/doctest.h"
+
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+import cxx.ipr.impl;
+
+TEST_CASE("type node throughput") {
+    // Template-heavy code spells many compound types over a few base types: pointers, qualified
+    // types, and function types over argument lists.
+    ipr::impl::Lexicon lexicon { };
+    std::vector<const ipr::Type*> types {
+        &lexicon.int_type(), &lexicon.char_type(), &lexicon.bool_type(), &lexicon.double_type(),
+    };
+    for (std::size_t k = 0; types.size() < 100000; ++k)
+        types.push_back(&lexicon.get_pointer(*types[k]));
+
+    for (int round = 0; round < 2; ++round)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        std::size_t requests = 0;
+        for (std::size_t k = 0; k < types.size(); ++k)
+        {
+            auto& t = *types[k];
+            auto& u = *types[(k * 7919) % types.size()];
+            ipr::impl::Warehouse<ipr::Type> args;
+            args.push_back(t);
+            args.push_back(u);
+            auto& q = lexicon.get_qualified(lexicon.const_qualifier(), t);
+            lexicon.get_function(lexicon.get_product(args), q);
+            lexicon.get_reference(q);
+            requests += 4;
+        }
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        std::cout << (round == 0 ? "making types: " : "finding types: ")
+                  << requests / elapsed.count() / 1e6 << " M requests/s\n";
+    }
+    CHECK(types.size() == 100000);
+}
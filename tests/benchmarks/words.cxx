@@ -0,0 +1,194 @@
+#include "doctest/doctest.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+
+import cxx.ipr.impl;
+
+namespace {
+    // Return the spelling of a word made of `prefix` followed by the decimal digits of `n`.
+    std::u8string numbered(std::u8string_view prefix, std::size_t n)
+    {
+        const auto digits = std::to_string(n);
+        return std::u8string{prefix} + std::u8string(digits.begin(), digits.end());
+    }
+
+    // Synthesize a stream of `count` identifiers as found in C++ sources: a few names recur very
+    // often, and a long tail of distinct names is referenced a few times each.
+    std::vector<std::u8string> identifier_stream(std::size_t count)
+    {
+        const char8_t* frequent[] {
+            u8"std", u8"size_t", u8"i", u8"n", u8"size", u8"value", u8"begin", u8"end", u8"first",
+            u8"second", u8"data", u8"result", u8"T", u8"operator", u8"x", u8"get", u8"type", u8"it",
+        };
+        const char8_t* stems[] {
+            u8"parse_", u8"make_", u8"visit_", u8"Node", u8"Expr", u8"get_", u8"is_", u8"m_", u8"Token",
+        };
+        std::vector<std::u8string> stream;
+        stream.reserve(count);
+        std::uint32_t seed = 42;
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            seed = seed * 1664525 + 1013904223;
+            if (seed >> 31)
+                stream.emplace_back(frequent[(seed >> 8) % std::size(frequent)]);
+            else
+                stream.push_back(numbered(stems[(seed >> 20) % std::size(stems)], (seed >> 4) % 50000));
+        }
+        return stream;
+    }
+}
+
+TEST_CASE("identifier interning throughput") {
+    const auto stream = identifier_stream(std::size_t{4} << 20);
+    ipr::util::string_pool pool { };
+    std::size_t total = 0;
+    for (int round = 0; round < 2; ++round)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        for (auto& id : stream)
+            total += pool.intern(id).size();
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        std::cout << (round == 0 ? "cold pool: " : "warm pool: ")
+                  << stream.size() / elapsed.count() / 1e6 << " M identifiers/s\n";
+    }
+    CHECK(total > 0);
+}
+
+TEST_CASE("keyword interning throughput") {
+    // Declarations are dense with keywords and fundamental type names, which the pool resolves
+    // against its table of known words before looking at the interned strings.
+    const char8_t* keywords[] {
+        u8"const", u8"int", u8"auto", u8"void", u8"static", u8"constexpr", u8"bool", u8"char",
+        u8"unsigned int", u8"long long", u8"typename", u8"class", u8"inline", u8"double", u8"this",
+    };
+    auto stream = identifier_stream(std::size_t{4} << 20);
+    std::uint32_t seed = 7;
+    for (auto& id : stream)
+    {
+        seed = seed * 1664525 + 1013904223;
+        if (seed % 4 != 0)
+            id = keywords[(seed >> 8) % std::size(keywords)];
+    }
+    ipr::util::string_pool pool { };
+    std::size_t total = 0;
+    const auto start = std::chrono::steady_clock::now();
+    for (auto& id : stream)
+        total += pool.intern(id).size();
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << "keyword-heavy: " << stream.size() / elapsed.count() / 1e6 << " M identifiers/s\n";
+    CHECK(total > 0);
+}
+
+TEST_CASE("batched identifier interning throughput") {
+    const auto stream = identifier_stream(std::size_t{4} << 20);
+    const std::vector<ipr::util::word_view> words(stream.begin(), stream.end());
+    constexpr std::size_t batch = 1024;
+    std::vector<const ipr::Identifier*> ids(words.size());
+    for (bool batched : { false, true })
+    {
+        ipr::impl::Lexicon lexicon { };
+        const auto start = std::chrono::steady_clock::now();
+        if (batched)
+        {
+            for (std::size_t i = 0; i < words.size(); i += batch)
+            {
+                const auto n = std::min(batch, words.size() - i);
+                lexicon.get_identifiers(std::span{ words }.subspan(i, n), std::span{ ids }.subspan(i, n));
+            }
+        }
+        else
+        {
+            for (std::size_t i = 0; i < words.size(); ++i)
+                ids[i] = &lexicon.get_identifier(words[i]);
+        }
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        std::cout << (batched ? "batched: " : "one by one: ")
+                  << words.size() / elapsed.count() / 1e6 << " M identifiers/s\n";
+        CHECK(ids.back()->string().characters() == words.back());
+    }
+}
+
+TEST_CASE("shared identifier interning throughput") {
+    const auto stream = identifier_stream(std::size_t{4} << 20);
+    for (unsigned threads : { 1u, 2u, 4u, 8u })
+    {
+        ipr::util::shared_string_pool pool { };
+        const auto start = std::chrono::steady_clock::now();
+        {
+            std::vector<std::jthread> workers;
+            for (unsigned t = 0; t < threads; ++t)
+                workers.emplace_back([&pool, &stream, t, threads] {
+                    for (auto i = t; i < stream.size(); i += threads)
+                        pool.intern(stream[i]);
+                });
+        }
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        std::cout << "threads " << threads << ": " << stream.size() / elapsed.count() / 1e6 << " M identifiers/s\n";
+    }
+}
+
+TEST_CASE("string pool startup over an image") {
+    // The common vocabulary of a library, as interned anew by every process, or mapped from an image.
+    std::vector<std::u8string> vocabulary;
+    for (int i = 0; i < 50000; ++i)
+        vocabulary.push_back(numbered(u8"std_", i));
+    ipr::util::string_pool seed { };
+    for (auto& w : vocabulary)
+        seed.intern(w);
+    std::ostringstream os;
+    seed.write_image(os);
+    const auto data = os.str();
+    const std::u8string bytes(data.begin(), data.end());
+
+    constexpr int runs = 20;
+    auto start = std::chrono::steady_clock::now();
+    for (int run = 0; run < runs; ++run)
+    {
+        ipr::util::string_pool pool { };
+        for (auto& w : vocabulary)
+            pool.intern(w);
+    }
+    const std::chrono::duration<double, std::micro> interning = std::chrono::steady_clock::now() - start;
+    start = std::chrono::steady_clock::now();
+    for (int run = 0; run < runs; ++run)
+    {
+        const ipr::util::string_image image { bytes };
+        ipr::util::string_pool pool { };
+        pool.layer_over(image);
+        CHECK(pool.id_bound() == seed.id_bound());
+    }
+    const std::chrono::duration<double, std::micro> layering = std::chrono::steady_clock::now() - start;
+    std::cout << "re-interning " << vocabulary.size() << " words: " << interning.count() / runs << " us, "
+              << "layering over an image of " << bytes.size() << " bytes: " << layering.count() / runs << " us\n";
+}
+
+TEST_CASE("identifier node throughput") {
+    constexpr std::size_t count = 1000000;
+    std::vector<std::u8string> names;
+    names.reserve(count);
+    for (std::size_t i = 0; i < count; ++i)
+        names.push_back(numbered(u8"name_", i * 7919 % count));
+    ipr::impl::Lexicon lexicon { };
+    std::vector<const ipr::String*> strings;
+    strings.reserve(count);
+    for (auto& n : names)
+        strings.push_back(&lexicon.get_string(n));
+    std::size_t total = 0;
+    for (int round = 0; round < 2; ++round)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        for (auto s : strings)
+            total += lexicon.get_identifier(s->characters()).string().size();
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        std::cout << (round == 0 ? "making " : "finding ") << count << " identifiers: "
+                  << count / elapsed.count() / 1e6 << " M identifiers/s\n";
+    }
+    CHECK(total > 0);
+}
@@ -0,0 +1,952 @@
+#include "doctest/doctest.h"
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "ipr/input"
+
+namespace {
+    // Scratch source file, removed on scope exit.
+    struct ScratchFile {
+        explicit ScratchFile(const std::string& text)
+            : path{std::filesystem::temp_directory_path() / "ipr-listing-test.txt"}
+        {
+            std::ofstream{path, std::ios::binary} << text;
+        }
+        ~ScratchFile() { std::filesystem::remove(path); }
+        std::filesystem::path path;
+    };
+
+    std::vector<ipr::input::PhysicalLine> physical_lines(const ScratchFile& scratch)
+    {
+        std::vector<ipr::input::PhysicalLine> lines;
+        ipr::input::SourceFile file{scratch.path.native()};
+        for (auto line : file.lines())
+            lines.push_back(line);
+        return lines;
+    }
+
+    // This predicate holds if two listings have the same logical lines.
+    bool same_lines(const ipr::input::SourceListing& x, const ipr::input::SourceListing& y)
+    {
+        const auto& xs = x.logical_lines();
+        const auto& ys = y.logical_lines();
+        if (xs.size() != ys.size())
+            return false;
+        for (std::size_t i = 0; i < xs.size(); ++i)
+        {
+            if (xs[i].sort() != ys[i].sort() or xs[i].species() != ys[i].species())
+                return false;
+            auto a = xs[i].sort() == ipr::input::LineSort::Simple
+                ? std::span{&x.simple_line(xs[i]).line, 1} : x.composite_line(xs[i]).lines;
+            auto b = ys[i].sort() == ipr::input::LineSort::Simple
+                ? std::span{&y.simple_line(ys[i]).line, 1} : y.composite_line(ys[i]).lines;
+            if (not std::ranges::equal(a, b, [](auto& l, auto& m) {
+                    return l.isle.offset == m.isle.offset and l.isle.length == m.isle.length
+                        and l.number == m.number and l.indent == m.indent;
+                }))
+                return false;
+        }
+        return true;
+    }
+}
+
+TEST_CASE("scan kernels agree") {
+    // Lines straddling vector widths, with assorted indentation and terminators.
+    std::string text = "\xEF\xBB\xBF#include <x>\r\n";
+    text += std::string(40, ' ') + "int x;\n";
+    text += std::string(17, '\t') + std::string(70, 'a') + "\r";
+    text += "\v\f  \n\n" + std::string(33, ' ') + '\n';
+    text += std::string(100, 'b') + "\\\n  c";
+    ScratchFile scratch{text};
+
+    const auto initial = ipr::input::scan_kernel();
+    ipr::input::use_scan_kernel(ipr::input::ScanKernel::Scalar);
+    const auto expected = physical_lines(scratch);
+    CHECK(expected.size() == 8);
+    CHECK(expected[1].indent == 40);
+    CHECK(expected[7].isle.length == 3);
+    for (auto k : { ipr::input::ScanKernel::SSE2, ipr::input::ScanKernel::AVX2 })
+    {
+        ipr::input::use_scan_kernel(k);
+        const auto lines = physical_lines(scratch);
+        REQUIRE(lines.size() == expected.size());
+        for (std::size_t i = 0; i < lines.size(); ++i)
+        {
+            CHECK(lines[i].isle.offset == expected[i].isle.offset);
+            CHECK(lines[i].isle.length == expected[i].isle.length);
+            CHECK(lines[i].indent == expected[i].indent);
+            CHECK(lines[i].number == expected[i].number);
+        }
+    }
+    ipr::input::use_scan_kernel(initial);
+}
+
+TEST_CASE("parallel listing matches serial listing") {
+    std::string text;
+    for (int i = 0; text.size() < (std::size_t{3} << 20); ++i)
+    {
+        switch (i % 5)
+        {
+        case 0: text += "#define MACRO_" + std::to_string(i) + "(x) \\\n    do { \\\r\n  f(x); \\   \n } while (0)\n"; break;
+        case 1: text += "    int variable_" + std::to_string(i) + " = " + std::to_string(i) + ";\n"; break;
+        case 2: text += "\n  \t \n"; break;
+        case 3: text += "#  if defined(X) \\\n\n"; break;
+        default: text += "}\r\n"; break;
+        }
+    }
+    ScratchFile scratch{text};
+
+    ipr::input::SourceListing serial{scratch.path.native()};
+    for (unsigned threads : { 2u, 3u, 8u })
+    {
+        ipr::input::SourceListing parallel{scratch.path.native(), { .threads = threads }};
+        CHECK(same_lines(serial, parallel));
+    }
+}
+
+TEST_CASE("logical lines") {
+    ScratchFile scratch{"  }\n#define X \\  \n  1\n   \t\n#  include <x>\n  \\\n\nint y; \\"};
+    ipr::input::SourceListing listing{scratch.path.native()};
+    const auto& lines = listing.logical_lines();
+    REQUIRE(lines.size() == 4);
+    CHECK(lines[0].species() == ipr::input::LineSpecies::Text);
+    CHECK(lines[1].sort() == ipr::input::LineSort::Composite);
+    CHECK(listing.composite_line(lines[1]).lines[0].isle.length == 10);
+    CHECK(lines[2].sort() == ipr::input::LineSort::Simple);
+    CHECK(lines[3].sort() == ipr::input::LineSort::Composite);
+    CHECK(lines[3].species() == ipr::input::LineSpecies::Text);
+}
+
+TEST_CASE("listing cache") {
+    const auto dir = std::filesystem::temp_directory_path() / "ipr-listing-cache";
+    std::filesystem::remove_all(dir);
+    ipr::input::ListingCache cache{dir.native()};
+    ScratchFile scratch{"#include <a>\n#define F(x) \\\n  (x)\nint f();\n"};
+    const ipr::input::ListingOptions options { .cache = &cache };
+
+    ipr::input::SourceListing fresh{scratch.path.native()};
+    ipr::input::SourceListing first{scratch.path.native(), options};
+    CHECK(cache.statistics().misses == 1);
+    ipr::input::SourceListing second{scratch.path.native(), options};
+    CHECK(cache.statistics().hits == 1);
+    CHECK(same_lines(fresh, first));
+    CHECK(same_lines(fresh, second));
+
+    // Corrupt the cache entry: it is rejected, and the listing is read anew.
+    for (auto& entry : std::filesystem::directory_iterator{dir})
+    {
+        std::fstream file{entry.path(), std::ios::in | std::ios::out | std::ios::binary};
+        file.seekp(-3, std::ios::end);
+        file.put('\x7F');
+    }
+    ipr::input::SourceListing third{scratch.path.native(), options};
+    CHECK(cache.statistics().rejects == 1);
+    CHECK(cache.statistics().misses == 2);
+    CHECK(same_lines(fresh, third));
+
+    // A modified source file makes its cache entry stale.
+    std::ofstream{scratch.path, std::ios::binary | std::ios::app} << "#endif\n";
+    ipr::input::SourceListing fourth{scratch.path.native(), options};
+    CHECK(cache.statistics().rejects == 2);
+    CHECK(fourth.logical_lines().size() == 4);
+
+    ipr::input::SourceListing fifth{scratch.path.native(), options};
+    CHECK(cache.statistics().hits == 2);
+    CHECK(same_lines(fourth, fifth));
+    std::filesystem::remove_all(dir);
+}
+
+TEST_CASE("listing cache trusts modification times") {
+    using namespace std::chrono_literals;
+    const auto dir = std::filesystem::temp_directory_path() / "ipr-mtime-cache";
+    std::filesystem::remove_all(dir);
+    ipr::input::ListingCache cache{dir.native()};
+    ScratchFile scratch{"#define A 1\nint a;\n"};
+    const ipr::input::ListingOptions options { .cache = &cache };
+    const auto past = std::filesystem::file_time_type::clock::now() - 1h;
+    std::filesystem::last_write_time(scratch.path, past);
+
+    ipr::input::SourceListing{scratch.path.native(), options};
+    ipr::input::SourceListing{scratch.path.native(), options};
+    CHECK(cache.statistics().misses == 1);
+    CHECK(cache.statistics().hits == 1);
+
+    // Another modification time, with the same contents: the entry is vouched for by its hash.
+    std::filesystem::last_write_time(scratch.path, past - 1min);
+    ipr::input::SourceListing{scratch.path.native(), options};
+    ipr::input::SourceListing{scratch.path.native(), options};
+    CHECK(cache.statistics().hits == 3);
+    CHECK(cache.statistics().rejects == 0);
+
+    // Contents of the same size, modified at another time, make the entry stale.
+    std::ofstream{scratch.path, std::ios::binary} << "#define B 2\nint b;\n";
+    std::filesystem::last_write_time(scratch.path, past - 2min);
+    ipr::input::SourceListing modified{scratch.path.native(), options};
+    CHECK(cache.statistics().rejects == 1);
+
+    // So do contents of the same size modified just now, whatever the time recorded.
+    std::ofstream{scratch.path, std::ios::binary} << "#define C 3\nint c;\n";
+    ipr::input::SourceListing recent{scratch.path.native(), options};
+    CHECK(cache.statistics().rejects == 2);
+    CHECK(recent.logical_lines().size() == 2);
+    std::filesystem::remove_all(dir);
+}
+
+namespace {
+    // Return a printable description of the logical lines of a depot.
+    std::string describe(const ipr::input::LineDepot& depot)
+    {
+        std::string s;
+        const auto put = [&](const ipr::input::PhysicalLine& line) {
+            s += ' ' + std::to_string(line.number) + ':' + std::to_string(line.isle.offset)
+               + '+' + std::to_string(depot.length(line.isle)) + '>' + std::to_string(line.indent);
+        };
+        for (auto x : depot.indices)
+        {
+            s += std::to_string(static_cast<int>(x.species()));
+            if (x.sort() == ipr::input::LineSort::Simple)
+                put(depot.simples[x.index()].line);
+            else
+                for (auto& line : depot.composite(depot.composites[x.index()]).lines)
+                    put(line);
+            s += '\n';
+        }
+        return s;
+    }
+
+    // Return a printable description of the logical lines of a listing.
+    std::string describe(const ipr::input::SourceListing& listing)
+    {
+        return describe(listing.revise(listing.contents(), { }));
+    }
+}
+
+TEST_CASE("incremental listing revision") {
+    const std::string pieces[] {
+        "int x;\n", "#define F(a) \\\n", "  a\n", "\n", "   \t\n", "#if X\n", "}\r\n",
+        "\\\n", "  \\  \n", "#endif", "y", "\n\n", "#", " include <z>\n", std::string(70000, 'w'),
+    };
+    std::uint64_t seed = 42;
+    const auto random = [&seed](std::uint64_t n) {
+        seed = seed * 6364136223846793005 + 1442695040888963407;
+        return (seed >> 33) % n;
+    };
+    const auto random_text = [&](std::size_t count) {
+        std::string text;
+        for (std::size_t i = 0; i < count; ++i)
+            text += pieces[random(std::size(pieces))];
+        return text;
+    };
+
+    for (int round = 0; round < 200; ++round)
+    {
+        const auto original = random_text(40);
+        std::string revised;
+        std::vector<std::string> insertions;
+        std::vector<ipr::input::TextEdit> edits;
+        std::uint64_t pos = 0;
+        for (auto n = random(4) + 1; n > 0 and pos < original.size(); --n)
+        {
+            auto offset = pos + random(original.size() - pos);
+            auto removed = random(std::min<std::uint64_t>(original.size() - offset, 12) + 1);
+            insertions.push_back(random(3) == 0 ? std::string{ } : random_text(random(3)));
+            revised += original.substr(pos, offset - pos) + insertions.back();
+            edits.push_back({ offset, removed, { } });
+            pos = offset + removed;
+        }
+        revised += original.substr(pos);
+        for (std::size_t i = 0; i < edits.size(); ++i)
+            edits[i].inserted = { reinterpret_cast<const char8_t*>(insertions[i].data()), insertions[i].size() };
+
+        std::string expected;
+        {
+            ScratchFile scratch{revised};
+            expected = describe(ipr::input::SourceListing{scratch.path.native()});
+        }
+        ScratchFile scratch{original};
+        ipr::input::SourceListing listing{scratch.path.native()};
+        const ipr::input::SourceFile::View text { reinterpret_cast<const char8_t*>(revised.data()), revised.size() };
+        const auto depot = listing.revise(text, edits);
+        REQUIRE(describe(depot) == expected);
+
+        // A revision can be further revised.
+        const ipr::input::TextEdit undo { 0, 0, { } };
+        CHECK(describe(ipr::input::revise_lines(depot, text, { &undo, 1 })) == expected);
+    }
+}
+
+TEST_CASE("incremental listing update") {
+    const std::string pieces[] {
+        "int x;\n", "#define F(a) \\\n", "  a\n", "\n", "#if X\n", "}\r\n", "\\\n", "#endif", "y", std::string(70000, 'w'),
+    };
+    std::uint64_t seed = 7;
+    const auto random = [&seed](std::uint64_t n) {
+        seed = seed * 6364136223846793005 + 1442695040888963407;
+        return (seed >> 33) % n;
+    };
+    const auto random_text = [&](std::size_t count) {
+        std::string text;
+        for (std::size_t i = 0; i < count; ++i)
+            text += pieces[random(std::size(pieces))];
+        return text;
+    };
+    const auto source = [](const std::string& text) {
+        auto bytes = std::make_unique<char8_t[]>(text.size());
+        std::ranges::copy(text, bytes.get());
+        return ipr::input::SourceFile{std::move(bytes), text.size()};
+    };
+
+    for (int round = 0; round < 50; ++round)
+    {
+        auto text = random_text(30);
+        ipr::input::SourceListing listing{source(text)};
+        // Several updates in a row, with the lines read only now and then.
+        for (int update = 0; update < 6; ++update)
+        {
+            std::string revised;
+            std::vector<std::string> insertions;
+            std::vector<ipr::input::TextEdit> edits;
+            std::uint64_t pos = 0;
+            for (auto n = random(3) + 1; n > 0 and pos < text.size(); --n)
+            {
+                auto offset = pos + random(text.size() - pos);
+                auto removed = random(std::min<std::uint64_t>(text.size() - offset, 12) + 1);
+                insertions.push_back(random_text(random(3)));
+                revised += text.substr(pos, offset - pos) + insertions.back();
+                edits.push_back({ offset, removed, { } });
+                pos = offset + removed;
+            }
+            revised += text.substr(pos);
+            for (std::size_t i = 0; i < edits.size(); ++i)
+                edits[i].inserted = { reinterpret_cast<const char8_t*>(insertions[i].data()), insertions[i].size() };
+            listing.update(source(revised), edits);
+            text = std::move(revised);
+            if (random(3) == 0)
+                CHECK(same_lines(listing, ipr::input::SourceListing{source(text)}));
+        }
+        const ipr::input::SourceListing expected{source(text)};
+        REQUIRE(same_lines(listing, expected));
+        CHECK(describe(listing) == describe(expected));
+    }
+
+    // A revision makes a listing of its own.
+    const std::string text = "#if A\nint a;\n#endif\n";
+    ipr::input::SourceListing listing{source(text)};
+    const std::string revised = "#if A\nint a, \\\n b;\n#endif\n";
+    const ipr::input::TextEdit edit { 11, 0, u8", \\\n b" };
+    auto file = source(revised);
+    auto depot = listing.revise(file.contents(), { &edit, 1 });
+    const ipr::input::SourceListing revision{std::move(file), std::move(depot)};
+    CHECK(same_lines(revision, ipr::input::SourceListing{source(revised)}));
+}
+
+TEST_CASE("conditional structure") {
+    ScratchFile scratch{
+        "#ifndef GUARD\n"           // 0
+        "#define GUARD\n"           // 1
+        "#  if A\n"                 // 2
+        "int a;\n"                  // 3
+        "#  elif \\\n B\n"          // 4
+        "#    ifdef C\n"            // 5
+        "#    endif\n"              // 6
+        "#  else\n"                 // 7
+        "#  endif\n"                // 8
+        "#endif\n"                  // 9
+        "#else\n"                   // 10
+        "#endif\n"                  // 11
+        "#if X\n"                   // 12
+        "#else\n"                   // 13
+        "#elif Y\n"                 // 14
+        "#else\n"                   // 15
+        "#ifdef Z\n"                // 16
+    };
+    ipr::input::SourceListing listing{scratch.path.native()};
+    ipr::input::ConditionalStructure conditionals{listing};
+    REQUIRE(listing.logical_lines().size() == 17);
+    CHECK(listing.logical_lines()[4].species() == ipr::input::LineSpecies::Elif);
+
+    CHECK(conditionals.next_group(0) == 9);
+    CHECK(conditionals.endif(0) == 9);
+    CHECK(conditionals.next_group(1) == 1);
+    CHECK(conditionals.next_group(2) == 4);
+    CHECK(conditionals.next_group(4) == 7);
+    CHECK(conditionals.next_group(7) == 8);
+    CHECK(conditionals.endif(4) == 8);
+    CHECK(conditionals.endif(5) == 6);
+    CHECK(conditionals.next_group(12) == 13);
+    CHECK(conditionals.next_group(15) == 17);
+    CHECK(conditionals.endif(13) == 17);
+    CHECK(conditionals.endif(16) == 17);
+
+    using Defect = ipr::input::ConditionalStructure::Defect;
+    const auto& defects = conditionals.malformations();
+    REQUIRE(defects.size() == 6);
+    CHECK(defects[0].defect == Defect::UnmatchedElse);
+    CHECK(defects[0].line == 12);
+    CHECK(defects[1].defect == Defect::UnmatchedEndif);
+    CHECK(defects[1].line == 13);
+    CHECK(defects[2].defect == Defect::UnterminatedIf);
+    CHECK(defects[2].line == 14);
+    CHECK(defects[3].defect == Defect::ElifAfterElse);
+    CHECK(defects[3].line == 16);
+    CHECK(defects[4].defect == Defect::DuplicateElse);
+    CHECK(defects[5].defect == Defect::UnterminatedIf);
+    CHECK(defects[5].line == 18);
+}
+
+TEST_CASE("conditional directives within block comments") {
+    ScratchFile scratch{
+        "#if A /* opens\n"          // 0
+        "#if B\n"                   // 1
+        "#endif */\n"               // 2
+        "int s = '\"' /* x */;\n"   // 3
+        "const char* t = \"/*\";\n" // 4
+        "#else\n"                   // 5
+        "int n = 1'0; /*\n"         // 6
+        "#endif\n"                  // 7
+        "  */ int m;\n"             // 8
+        "// /*\n"                   // 9
+        "#endif\n"                  // 10
+    };
+    ipr::input::SourceListing listing{scratch.path.native()};
+    ipr::input::ConditionalStructure conditionals{listing};
+    REQUIRE(listing.logical_lines().size() == 11);
+    CHECK(listing.logical_lines()[1].species() == ipr::input::LineSpecies::If);
+
+    CHECK(conditionals.commented(1));
+    CHECK(conditionals.commented(2));
+    CHECK(conditionals.commented(7));
+    CHECK(not conditionals.commented(0));
+    CHECK(not conditionals.commented(5));
+    CHECK(not conditionals.commented(10));
+    CHECK(conditionals.next_group(0) == 5);
+    CHECK(conditionals.next_group(5) == 10);
+    CHECK(conditionals.endif(0) == 10);
+    CHECK(conditionals.endif(1) == 1);
+    CHECK(conditionals.malformations().empty());
+}
+
+TEST_CASE("dependency scanning") {
+    ScratchFile scratch{
+        "module;\n"                         // 1
+        "#include <vector>\n"               // 2
+        "  #  include \"a \\\\ b.h\"\n"     // 3
+        "#include CONFIG(x) \n"             // 4
+        "#import <objc.h>\n"                // 5
+        "export module M . N:part;\n"       // 6
+        "import std;\n"                     // 7
+        "export import :P [[deprecated]];\n"// 8
+        "import <ma\\\nth.h>;\n"            // 9
+        "importance = import_(1);\n"        // 11
+        "import ::x;\n"                     // 12
+        "exported = 1;\n"                   // 13
+        "#embed \"data.bin\" limit(8)\n"    // 14
+        "#define import\n"                  // 15
+    };
+    using ipr::input::DependencySort;
+    using ipr::input::LineSpecies;
+    ipr::input::SourceListing listing{scratch.path.native()};
+    const auto& lines = listing.logical_lines();
+    REQUIRE(lines.size() == 14);
+    CHECK(lines[5].species() == LineSpecies::Export);
+    CHECK(lines[6].species() == LineSpecies::Import);
+    CHECK(lines[8].species() == LineSpecies::Import);
+    CHECK(lines[9].species() == LineSpecies::Text);
+    CHECK(lines[10].species() == LineSpecies::Text);
+    CHECK(lines[11].species() == LineSpecies::Text);
+
+    const auto deps = ipr::input::dependencies(listing);
+    REQUIRE(deps.size() == 9);
+    const std::pair<DependencySort, std::u8string_view> expected[] {
+        { DependencySort::Include, u8"<vector>" },
+        { DependencySort::Include, u8"\"a \\\\ b.h\"" },
+        { DependencySort::Include, u8"CONFIG(x)" },
+        { DependencySort::Include, u8"<objc.h>" },
+        { DependencySort::Module, u8"M.N:part" },
+        { DependencySort::Import, u8"std" },
+        { DependencySort::Import, u8":P" },
+        { DependencySort::Import, u8"<math.h>" },
+        { DependencySort::Embed, u8"\"data.bin\"" },
+    };
+    for (std::size_t i = 0; i < deps.size(); ++i)
+    {
+        CHECK(deps[i].sort == expected[i].first);
+        CHECK(deps[i].name == expected[i].second);
+    }
+    CHECK(deps[0].line == 2);
+    CHECK(deps[7].line == 9);
+    CHECK(deps[8].line == 14);
+
+    const ipr::input::SystemPath paths[] { scratch.path.native(), scratch.path.native() + "-missing" };
+    const auto records = ipr::input::scan_dependencies(paths, 2);
+    REQUIRE(records.size() == 2);
+    CHECK(records[0].error == nullptr);
+    CHECK(records[0].dependencies.size() == deps.size());
+    CHECK(records[1].error != nullptr);
+
+    std::ostringstream os;
+    ipr::input::write_json_line(os, records[0]);
+    const auto json = os.str();
+    CHECK(json.ends_with(",\"provides\":[\"M.N:part\"],\"imports\":[\"std\",\":P\",\"<math.h>\"],"
+                         "\"includes\":[\"<vector>\",\"\\\"a \\\\\\\\ b.h\\\"\",\"CONFIG(x)\",\"<objc.h>\"],"
+                         "\"embeds\":[\"\\\"data.bin\\\"\"]}\n"));
+    os.str({ });
+    ipr::input::write_json_line(os, records[1]);
+    CHECK(os.str().find("\"error\":\"cannot access file\"") != std::string::npos);
+}
+
+TEST_CASE("source set") {
+    ScratchFile small{"#include <a.h>\nint x;\n"};
+    const auto dir = std::filesystem::temp_directory_path() / "ipr-source-set-test";
+    std::filesystem::create_directories(dir);
+    const auto large = dir / "large.h";
+    const auto alias = dir / "alias.h";
+    std::ofstream{large, std::ios::binary} << std::string(100, 'x') << "\n#import \"b.h\"\n";
+    std::filesystem::remove(alias);
+    std::filesystem::create_hard_link(large, alias);
+
+    const ipr::input::SystemPath paths[] {
+        small.path.native(), large.native(), (dir / "missing.h").native(), alias.native(), dir.native(),
+    };
+    for (auto backend : { ipr::input::LoadBackend::Mapped, ipr::input::LoadBackend::Ring })
+    {
+        std::vector<std::size_t> dependency_counts(std::size(paths));
+        const auto handler = [&](const ipr::input::SourceSet& set, std::size_t n) {
+            if (set.error(n) == nullptr)
+                dependency_counts[n] = ipr::input::dependencies(set.listing(n)).size() + 1;
+        };
+        ipr::input::SourceSet set{paths, { .threads = 3, .backend = backend, .small_file_size = 64 }, handler};
+        REQUIRE(set.size() == 5);
+        CHECK(set.distinct_files() == 2);
+        CHECK(set.error(0) == nullptr);
+        CHECK(set.error(2) != nullptr);
+        CHECK_THROWS_AS(set.file(2), ipr::input::AccessError);
+        CHECK_THROWS_AS(set.file(4), ipr::input::RegularFileError);
+        CHECK(set.file(1).contents().data() == set.file(3).contents().data());
+        CHECK(set.file(0).contents().size() == 22);
+        CHECK(dependency_counts == std::vector<std::size_t>{ 2, 2, 0, 2, 0 });
+
+        for (std::size_t i : { 0, 1, 3 })
+        {
+            const ipr::input::SourceListing expected{set.path(i)};
+            const auto listing = set.listing(i);
+            CHECK(same_lines(listing, expected));
+        }
+    }
+    std::filesystem::remove_all(dir);
+}
+
+TEST_CASE("long lines") {
+    const std::string long_line(70000, 'x');
+    const std::string text = "#include <" + long_line + ">\n"
+        + "int a = \\\n" + long_line + " \\\n" + long_line + ";\n"
+        + std::string(80000, ' ') + "\\\n\n"
+        + "y" + long_line + long_line;
+    ScratchFile scratch{text};
+    ipr::input::SourceListing listing{scratch.path.native()};
+    const auto& lines = listing.logical_lines();
+    REQUIRE(lines.size() == 3);
+    CHECK(listing.line_depot().long_isles.size() == 4);
+
+    const auto& first = listing.simple_line(lines[0]).line;
+    CHECK(first.isle.length == ipr::input::Isle::overflow);
+    CHECK(listing.contents(first.isle, listing.line_depot()).size() == long_line.size() + 11);
+    CHECK(lines[0].species() == ipr::input::LineSpecies::Include);
+    const auto deps = ipr::input::dependencies(listing);
+    REQUIRE(deps.size() == 1);
+    CHECK(deps[0].name.size() == long_line.size() + 2);
+
+    const auto pieces = listing.composite_line(lines[1]).lines;
+    REQUIRE(pieces.size() == 3);
+    CHECK(listing.contents(pieces[1].isle, listing.line_depot()).size() == long_line.size() + 1);
+    CHECK(listing.contents(pieces[2].isle, listing.line_depot()).size() == long_line.size() + 1);
+    CHECK(listing.contents(listing.simple_line(lines[2]).line.isle, listing.line_depot()).size() == 2 * long_line.size() + 1);
+
+    // A long piece of a composite line read through a source file alone excludes its continuation.
+    const ipr::input::SourceFile file{scratch.path.native()};
+    const auto piece = file.contents(pieces[1].isle, listing.line_depot());
+    REQUIRE(piece.size() == long_line.size() + 1);
+    CHECK(piece.back() == u8' ');
+    CHECK(file.contents(pieces[1].isle).size() == ipr::input::Isle::overflow);
+    CHECK(std::ranges::equal(file.contents(pieces[1].isle), piece.first(ipr::input::Isle::overflow)));
+
+    // Raw physical lines saturate their length, and their indentation.
+    const auto physical = physical_lines(scratch);
+    REQUIRE(physical.size() == 7);
+    CHECK(physical[4].indent == ipr::input::Isle::overflow);
+
+    const auto dir = std::filesystem::temp_directory_path() / "ipr-long-lines-cache";
+    {
+        ipr::input::ListingCache cache{dir.native()};
+        ipr::input::SourceListing cold{scratch.path.native(), { .cache = &cache }};
+        ipr::input::SourceListing warm{scratch.path.native(), { .cache = &cache }};
+        CHECK(cache.statistics().hits == 1);
+        CHECK(describe(warm) == describe(listing));
+    }
+    std::filesystem::remove_all(dir);
+
+    // Enough text for several chunks to be read in parallel.
+    std::string big;
+    for (int i = 0; i < 20; ++i)
+        big += text + "\n";
+    ScratchFile large{big};
+    ipr::input::SourceListing serial{large.path.native()};
+    ipr::input::SourceListing parallel{large.path.native(), { .threads = 4 }};
+    CHECK(serial.line_depot().long_isles.size() == 80);
+    CHECK(describe(parallel) == describe(serial));
+}
+
+TEST_CASE("composite lines of too many physical lines") {
+    std::string text = "int x;\n";
+    for (int i = 0; i < 65536; ++i)
+        text += "a \\\n";
+    text += "b\n";
+    const std::u8string buffer(text.begin(), text.end());
+    try
+    {
+        ipr::input::SourceListing listing{ipr::input::SourceFile{buffer}};
+        FAIL("a composite line of 65537 physical lines was accepted");
+    }
+    catch (const ipr::input::SpliceError& e)
+    {
+        CHECK(e.line == 2);
+    }
+
+    // The longest composite line fits.
+    text.erase(text.size() - 10, 8);
+    const std::u8string fitting(text.begin(), text.end());
+    ipr::input::SourceListing listing{ipr::input::SourceFile{fitting}};
+    CHECK(listing.logical_lines().size() == 2);
+}
+
+TEST_CASE("line and column positions") {
+    // Byte order mark, assorted terminators, multi-byte code points, and a line over 32 bytes.
+    const std::string text = "\xEF\xBB\xBF" "ab\r\n"
+        "\xC3\xA9t\xC3\xA9\r"
+        "\r\n"
+        "\t\xE2\x82\xAC = \xF0\x9F\x98\x80;\n"
+        + std::string(40, ' ') + "\xCE\xBB" + std::string(30, 'z') + "\xCE\xBB\n"
+        "end";
+    ScratchFile scratch{text};
+    ipr::input::SourceListing listing{scratch.path.native()};
+
+    // Naive reference: walk the text byte by byte.
+    std::vector<ipr::input::LineColumn> expected;
+    std::uint64_t line = 1;
+    std::uint64_t column = 0;
+    for (std::size_t i = 0; i < text.size(); ++i)
+    {
+        const auto c = static_cast<unsigned char>(text[i]);
+        if (i >= 3 and (c & 0xC0) != 0x80)
+            ++column;
+        expected.push_back({ line, std::max<std::uint64_t>(column, 1) });
+        if (c == '\n' or (c == '\r' and text[i + 1] != '\n'))
+        {
+            ++line;
+            column = 0;
+        }
+    }
+    expected.push_back({ line, column + 1 });
+
+    const auto initial = ipr::input::scan_kernel();
+    for (auto k : { ipr::input::ScanKernel::Scalar, ipr::input::ScanKernel::SSE2, ipr::input::ScanKernel::AVX2 })
+    {
+        ipr::input::use_scan_kernel(k);
+        for (std::size_t i = 0; i <= text.size(); ++i)
+        {
+            const auto p = listing.position(i);
+            CHECK(p.line == expected[i].line);
+            CHECK(p.column == expected[i].column);
+        }
+    }
+    ipr::input::use_scan_kernel(initial);
+
+    CHECK(listing.position(3).line == 1);
+    CHECK(listing.position(3).column == 1);
+    CHECK(listing.position(9).column == 2);     // `t` following `é`.
+    CHECK(listing.position(text.size()).line == 6);
+    CHECK(listing.position(text.size()).column == 4);
+}
+
+namespace {
+    // Naive reference: decode each code point, then reject overlong forms, surrogates, and values
+    // beyond U+10FFFF.
+    std::uint64_t naive_invalid_utf8(std::u8string_view text)
+    {
+        std::size_t i = 0;
+        while (i < text.size())
+        {
+            const auto c = text[i];
+            const std::size_t n = c < 0x80 ? 1 : c < 0xC0 ? 0 : c < 0xE0 ? 2 : c < 0xF0 ? 3 : c < 0xF8 ? 4 : 0;
+            if (n == 0 or i + n > text.size())
+                return i;
+            char32_t value = n == 1 ? c : c & (0x7F >> n);
+            for (std::size_t j = 1; j < n; ++j)
+            {
+                if ((text[i + j] & 0xC0) != 0x80)
+                    return i;
+                value = value << 6 | (text[i + j] & 0x3F);
+            }
+            constexpr char32_t least[] { 0, 0, 0x80, 0x800, 0x10000 };
+            if (value < least[n] or value > 0x10FFFF or (value >= 0xD800 and value <= 0xDFFF))
+                return i;
+            i += n;
+        }
+        return text.size();
+    }
+}
+
+TEST_CASE("UTF-8 validation") {
+    constexpr ipr::input::ScanKernel kernels[] {
+        ipr::input::ScanKernel::Scalar, ipr::input::ScanKernel::SSE2, ipr::input::ScanKernel::AVX2
+    };
+    const auto initial = ipr::input::scan_kernel();
+    const auto agree = [&](const std::u8string& text) {
+        const auto expected = naive_invalid_utf8(text);
+        for (auto k : kernels)
+        {
+            ipr::input::use_scan_kernel(k);
+            if (ipr::input::first_invalid_utf8(text) != expected)
+                return false;
+        }
+        return true;
+    };
+
+    // Every pair of bytes, and every lead of a longer sequence with assorted continuations, placed
+    // so as to straddle the boundary between two vectors, or to end the text.
+    int disagreements = 0;
+    for (std::size_t pad : { 30u, 31u, 45u })
+    {
+        for (unsigned x = 0x80; x < 0x100; ++x)
+        {
+            for (unsigned y = 0; y < 0x100; ++y)
+            {
+                const std::u8string pair { char8_t(x), char8_t(y) };
+                disagreements += not agree(std::u8string(pad, u8'a') + pair + u8"bc");
+                disagreements += not agree(std::u8string(pad, u8'a') + pair);
+                if (x < 0xE0)
+                    continue;
+                for (char8_t z : { 0x41, 0x80, 0xBF, 0xC3 })
+                {
+                    disagreements += not agree(std::u8string(pad, u8'a') + pair + z + u8"\x80z");
+                    disagreements += not agree(std::u8string(pad, u8'a') + pair + z);
+                }
+            }
+        }
+    }
+    CHECK(disagreements == 0);
+
+    // Random mixtures of well-formed code points and stray bytes.
+    const std::u8string pieces[] {
+        u8"int x;", u8"é", u8"€", u8"\U0001F600", u8"�", u8"\U0010FFFF", u8"\n",
+        u8"\xED\xA0\x80", u8"\xF4\x90\x80\x80", u8"\xC0\xAF", u8"\x80", u8"\xF0\x9F\x98", u8"\xFF",
+    };
+    std::uint32_t seed = 7;
+    for (int round = 0; round < 2000; ++round)
+    {
+        std::u8string text;
+        const bool clean = round % 2 == 0;
+        for (int i = 0; i < 40; ++i)
+        {
+            seed = seed * 1664525 + 1013904223;
+            text += pieces[(seed >> 8) % (clean ? 7 : std::size(pieces))];
+        }
+        CHECK(agree(text));
+    }
+    ipr::input::use_scan_kernel(initial);
+
+    // Listings raise an exception designating the first ill-formed sequence, only on request.
+    std::string text = "\xEF\xBB\xBF" "int \xC3\xA9t\xC3\xA9;\n";
+    while (text.size() < (std::size_t{1} << 20))
+        text += "// \xE2\x82\xAC " + std::to_string(text.size()) + "\n";
+    const auto bad = text.rfind("//");
+    text[bad] = '\xC0';
+    ScratchFile scratch{text};
+    CHECK(ipr::input::SourceListing{scratch.path.native()}.logical_lines().size() > 1);
+    const auto dir = std::filesystem::temp_directory_path() / "ipr-utf8-cache";
+    std::filesystem::remove_all(dir);
+    ipr::input::ListingCache cache{dir.native()};
+    ipr::input::SourceListing{scratch.path.native(), { .cache = &cache }};
+    for (ipr::input::ListingOptions options : {
+            ipr::input::ListingOptions{ .validate_utf8 = true },
+            ipr::input::ListingOptions{ .threads = 4, .validate_utf8 = true },
+            ipr::input::ListingOptions{ .cache = &cache, .validate_utf8 = true } })
+    {
+        try {
+            ipr::input::SourceListing listing{scratch.path.native(), options};
+            CHECK(false);
+        }
+        catch (const ipr::input::EncodingError& e) {
+            CHECK(e.path == scratch.path.native());
+            CHECK(e.offset == bad);
+        }
+    }
+    CHECK(cache.statistics().hits == 1);
+    text[bad] = ' ';
+    ScratchFile fixed{text};
+    CHECK(ipr::input::SourceListing{fixed.path.native(), { .threads = 4, .validate_utf8 = true }}.logical_lines().size() > 1);
+    std::filesystem::remove_all(dir);
+}
+
+TEST_CASE("listings of texts held in memory") {
+    const std::string text = "#include <vector>\nint f(int x) \\\n  { return x; }\n// Edited, not saved.\n";
+    ScratchFile scratch{text};
+    ipr::input::SourceListing on_disk{scratch.path.native()};
+
+    // A borrowed text is not copied.
+    const std::u8string buffer { text.begin(), text.end() };
+    ipr::input::SourceListing borrowed{ipr::input::SourceFile{buffer}};
+    CHECK(borrowed.contents().data() == buffer.data());
+    CHECK(borrowed.contents().size() == buffer.size());
+
+    // An adopted text is not copied either, and is released with the listing.
+    auto storage = std::make_unique<char8_t[]>(text.size());
+    std::copy(text.begin(), text.end(), storage.get());
+    const auto address = storage.get();
+    ipr::input::SourceListing owned{ipr::input::SourceFile{std::move(storage), text.size()}};
+    CHECK(owned.contents().data() == address);
+    auto moved = std::move(owned);
+    CHECK(moved.contents().data() == address);
+
+    for (auto* listing : { &borrowed, &moved })
+    {
+        REQUIRE(listing->logical_lines().size() == on_disk.logical_lines().size());
+        for (std::size_t i = 0; i < on_disk.logical_lines().size(); ++i)
+        {
+            CHECK(listing->logical_lines()[i].sort() == on_disk.logical_lines()[i].sort());
+            CHECK(listing->logical_lines()[i].species() == on_disk.logical_lines()[i].species());
+        }
+        CHECK(listing->position(text.find("return")).line == 3);
+    }
+
+    // No cache entry is made for a text without a path, and its encoding errors designate no file.
+    const auto dir = std::filesystem::temp_directory_path() / "ipr-memory-cache";
+    std::filesystem::remove_all(dir);
+    ipr::input::ListingCache cache{dir.native()};
+    ipr::input::SourceListing{ipr::input::SourceFile{buffer}, { .cache = &cache }};
+    CHECK(cache.statistics().misses == 0);
+    CHECK(std::filesystem::is_empty(dir));
+    const std::u8string bad = u8"int x;\n\xFF\n";
+    try {
+        ipr::input::SourceListing{ipr::input::SourceFile{bad}, { .validate_utf8 = true }};
+        CHECK(false);
+    }
+    catch (const ipr::input::EncodingError& e) {
+        CHECK(e.path.empty());
+        CHECK(e.offset == 7);
+    }
+    std::filesystem::remove_all(dir);
+
+    CHECK(ipr::input::SourceListing{ipr::input::SourceFile{ipr::input::SourceFile::View{ }}}.logical_lines().empty());
+}
+
+TEST_CASE("inclusion guards") {
+    const auto guard_of = [](const std::string& text) {
+        ScratchFile scratch{text};
+        return ipr::input::inclusion_guard(ipr::input::SourceListing{scratch.path.native()});
+    };
+
+    auto guard = guard_of("// Copyright.\n/* Notice,\n   continued. */\n\n#ifndef A_H\n#define A_H\n"
+                          "#ifdef X\nint x;\n#else\nint y;\n#endif\n#endif // A_H\n\n// Trailer.\n");
+    CHECK(guard.macro == u8"A_H");
+    CHECK(not guard.pragma_once);
+    CHECK(guard.guarded());
+    CHECK(guard_of("#if !defined(B_H) /* guard */\n#  define B_H 1\nint b;\n#endif\n").macro == u8"B_H");
+    CHECK(guard_of("  #  if ! defined C_H\n#define C_H\n#endif").macro == u8"C_H");
+    CHECK(guard_of("#ifndef \\\n  D_H\n#define D_H\n#endif\n").macro == u8"D_H");
+
+    // Shapes that are not include guards.
+    CHECK(guard_of("int a;\n#ifndef A_H\n#define A_H\n#endif\n").macro.empty());
+    CHECK(guard_of("#ifndef A_H\n#define A_H\n#endif\nint a;\n").macro.empty());
+    CHECK(guard_of("#ifndef A_H\n#define A_H\n#else\nint a;\n#endif\n").macro.empty());
+    CHECK(guard_of("#ifndef A_H\n#define B_H\n#endif\n").macro.empty());
+    CHECK(guard_of("#ifndef A_H\n#define A_HX\n#endif\n").macro.empty());
+    CHECK(guard_of("#ifndef A_H\nint a;\n#define A_H\n#endif\n").macro.empty());
+    CHECK(guard_of("#ifndef A_H\n#define A_H\n").macro.empty());
+    CHECK(guard_of("#if !defined(A_H) && B\n#define A_H\n#endif\n").macro.empty());
+    CHECK(guard_of("#ifdef A_H\n#define A_H\n#endif\n").macro.empty());
+    CHECK(guard_of("/*\n#ifndef A_H\n#define A_H\n#endif\n*/\n").macro.empty());
+    CHECK(guard_of("#ifndef A_H\n#define A_H\n/*\n#endif\n*/\n#endif\n").macro == u8"A_H");
+    CHECK(guard_of("#ifndef A_H\n#define A_H\n#endif /*\n*/ int a;\n").macro.empty());
+    CHECK(guard_of("#ifndef A_H\n#define A_H\n#endif\n#ifndef B_H\n#define B_H\n#endif\n").macro.empty());
+    CHECK(not guard_of("int a;\n").guarded());
+    CHECK(not guard_of("").guarded());
+
+    // Only unconditional `#pragma once` directives protect a file.
+    guard = guard_of("// Header.\n#pragma once\n#if X\nint x;\n#endif\n");
+    CHECK(guard.pragma_once);
+    CHECK(guard.macro.empty());
+    CHECK(guard_of("#ifndef A_H\n#define A_H\n#pragma once\n#endif\n").pragma_once);
+    CHECK(not guard_of("#ifdef X\n#pragma once\n#endif\n").pragma_once);
+    CHECK(not guard_of("#pragma onced\n").pragma_once);
+    CHECK(not guard_of("#pragma once extra\n").pragma_once);
+    CHECK(not guard_of("#pragma GCC once\n").pragma_once);
+    CHECK(not guard_of("/* Header.\n#pragma once\n*/\n").pragma_once);
+}
+
+TEST_CASE("directive tokens") {
+    const std::string text =
+        "#include <vector> // comment\n"
+        "int x = 1;\n"
+        "#  define MAX(a, b) ((a) > (b) ? (a) : (b)) /* block */\n"
+        "\n"
+        "#if __cplusplus >= 202002L && VERSION != 0x1'00p+3\n"
+        "#error u8\"unterminated \\\" quote\" L'x' R\"d(a)\"b)d\"\n"
+        "#define SPLIT ab\\\ncd %:%: ...\n"
+        "import <map>;\n"
+        "#embed \"data.bin\" limit(10) @\n";
+    ScratchFile scratch{text};
+    ipr::input::SourceListing listing{scratch.path.native()};
+    ipr::input::DirectiveTokens tokens{listing};
+    REQUIRE(listing.logical_lines().size() == 8);
+
+    using ipr::input::TokenKind;
+    const auto spelling = [&](std::size_t t) {
+        return std::string{ text.substr(tokens.offset(t), tokens.length(t)) };
+    };
+    const auto line = [&](std::size_t n) {
+        std::vector<std::pair<TokenKind, std::string>> result;
+        for (auto t = tokens.first_token(n); t < tokens.first_token(n) + tokens.token_count(n); ++t)
+            result.emplace_back(tokens.kind(t), spelling(t));
+        return result;
+    };
+    using Tokens = std::vector<std::pair<TokenKind, std::string>>;
+
+    CHECK(line(0) == Tokens{ { TokenKind::Punctuator, "#" }, { TokenKind::Identifier, "include" },
+                             { TokenKind::HeaderName, "<vector>" } });
+    CHECK(tokens.token_count(1) == 0);
+    CHECK(line(2).size() == 25);
+    CHECK(line(2)[3] == std::pair{ TokenKind::Punctuator, std::string{"("} });
+    CHECK(line(3) == Tokens{ { TokenKind::Punctuator, "#" }, { TokenKind::Identifier, "if" },
+                             { TokenKind::Identifier, "__cplusplus" }, { TokenKind::Punctuator, ">=" },
+                             { TokenKind::Number, "202002L" }, { TokenKind::Punctuator, "&&" },
+                             { TokenKind::Identifier, "VERSION" }, { TokenKind::Punctuator, "!=" },
+                             { TokenKind::Number, "0x1'00p+3" } });
+    CHECK(line(4) == Tokens{ { TokenKind::Punctuator, "#" }, { TokenKind::Identifier, "error" },
+                             { TokenKind::String, "u8\"unterminated \\\" quote\"" },
+                             { TokenKind::Character, "L'x'" }, { TokenKind::String, "R\"d(a)\"b)d\"" } });
+
+    // A token straddling physical lines extends over the line splice.
+    const auto split = line(5);
+    REQUIRE(split.size() == 6);
+    CHECK(split[2] == std::pair{ TokenKind::Identifier, std::string{"SPLIT"} });
+    CHECK(split[3] == std::pair{ TokenKind::Identifier, std::string{"ab\\\ncd"} });
+    CHECK(tokens.spliced(tokens.first_token(5) + 3));
+    CHECK(not tokens.spliced(tokens.first_token(5) + 2));
+    CHECK(split[4] == std::pair{ TokenKind::Punctuator, std::string{"%:%:"} });
+    CHECK(split[5] == std::pair{ TokenKind::Punctuator, std::string{"..."} });
+
+    CHECK(line(6) == Tokens{ { TokenKind::Identifier, "import" }, { TokenKind::HeaderName, "<map>" },
+                             { TokenKind::Punctuator, ";" } });
+    CHECK(line(7) == Tokens{ { TokenKind::Punctuator, "#" }, { TokenKind::Identifier, "embed" },
+                             { TokenKind::HeaderName, "\"data.bin\"" }, { TokenKind::Identifier, "limit" },
+                             { TokenKind::Punctuator, "(" }, { TokenKind::Number, "10" },
+                             { TokenKind::Punctuator, ")" }, { TokenKind::Other, "@" } });
+    CHECK(tokens.size() == tokens.first_token(7) + 8);
+    CHECK(tokens.kinds().size() == tokens.size());
+}
@@ -93,3 +93,36 @@ TEST_CASE("User-defined types have defined types") {
   CHECK(physically_same(namespace_udt->type(), lexicon.namespace_type()));
 }
 
+TEST_CASE("Type nodes are unified") {
+  using namespace ipr;
+  impl::Lexicon lexicon { };
+  auto& i = lexicon.int_type();
+  auto& c = lexicon.char_type();
+  CHECK(physically_same(lexicon.get_pointer(i), lexicon.get_pointer(i)));
+  CHECK(not physically_same(lexicon.get_pointer(i), lexicon.get_pointer(c)));
+  CHECK(physically_same(lexicon.get_reference(lexicon.get_pointer(c)), lexicon.get_reference(lexicon.get_pointer(c))));
+  CHECK(physically_same(lexicon.get_qualified(lexicon.const_qualifier(), i),
+                        lexicon.get_qualified(lexicon.const_qualifier(), i)));
+  CHECK(not physically_same(lexicon.get_qualified(lexicon.const_qualifier(), i),
+                            lexicon.get_qualified(lexicon.volatile_qualifier(), i)));
+  CHECK(not physically_same(lexicon.get_ptr_to_member(i, c), lexicon.get_ptr_to_member(c, i)));
+
+  impl::Warehouse<Type> ic;
+  ic.push_back(i);
+  ic.push_back(c);
+  impl::Warehouse<Type> ic2;
+  ic2.push_back(i);
+  ic2.push_back(c);
+  impl::Warehouse<Type> ci;
+  ci.push_back(c);
+  ci.push_back(i);
+  auto& args = lexicon.get_product(ic);
+  CHECK(physically_same(args, lexicon.get_product(ic2)));
+  CHECK(physically_same(args, lexicon.get_product(args.operand())));
+  CHECK(not physically_same(args, lexicon.get_product(ci)));
+  CHECK(physically_same(lexicon.get_function(args, i), lexicon.get_function(args, i)));
+  CHECK(not physically_same(lexicon.get_function(args, i), lexicon.get_function(args, c)));
+
+  auto& n = lexicon.get_identifier(u8"size_type");
+  CHECK(physically_same(lexicon.get_as_type(n), lexicon.get_as_type(n)));
+}
@@ -1,7 +1,23 @@
 #include "doctest/doctest.h"
 
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
 import cxx.ipr.impl;
 
+namespace {
+    // Return the spelling of a word made of `prefix` followed by the decimal digits of `n`.
+    std::u8string numbered(std::u8string_view prefix, std::size_t n)
+    {
+        const auto digits = std::to_string(n);
+        return std::u8string{prefix} + std::u8string(digits.begin(), digits.end());
+    }
+}
+
 TEST_CASE("words are unified")
 {
     ipr::util::string_pool pool { };
@@ -14,3 +30,203 @@ TEST_CASE("words are unified")
     auto& foo2 = pool.intern(u8"fhoo");
     CHECK(ipr::physically_same(foo1, foo2));
 }
+
+TEST_CASE("interned words survive table growth")
+{
+    ipr::util::string_pool pool { };
+    std::vector<const ipr::String*> firsts;
+    for (int i = 0; i < 5000; ++i)
+        firsts.push_back(&pool.intern(numbered(u8"name_", i)));
+    for (int i = 0; i < 5000; ++i)
+    {
+        auto& again = pool.intern(numbered(u8"name_", i));
+        CHECK(ipr::physically_same(again, *firsts[i]));
+        CHECK(again.characters() == numbered(u8"name_", i));
+    }
+    CHECK(not ipr::physically_same(*firsts[0], *firsts[1]));
+    CHECK(ipr::physically_same(pool.intern(u8"int"), pool.intern(std::u8string{u8"int"})));
+}
+
+TEST_CASE("words interned concurrently are unified")
+{
+    constexpr int threads = 4;
+    constexpr int count = 20000;
+    ipr::util::shared_string_pool pool { };
+    std::vector<std::vector<const ipr::String*>> interned(threads, std::vector<const ipr::String*>(count));
+    {
+        std::vector<std::jthread> workers;
+        for (int t = 0; t < threads; ++t)
+            workers.emplace_back([&pool, &words = interned[t], t] {
+                // Each thread visits the words in an order of its own.
+                for (int j = 0; j < count; ++j)
+                {
+                    const auto i = (j * 7919 + t * 4001) % count;
+                    words[i] = &pool.intern(numbered(u8"w", i));
+                }
+            });
+    }
+    int mismatches = 0;
+    for (int t = 1; t < threads; ++t)
+        for (int i = 0; i < count; ++i)
+            mismatches += not ipr::physically_same(*interned[t][i], *interned[0][i]);
+    CHECK(mismatches == 0);
+    CHECK(interned[0][42]->characters() == u8"w42");
+
+    // Lexicons sharing a pool share their strings.
+    ipr::impl::Lexicon lex1 { pool };
+    ipr::impl::Lexicon lex2 { pool };
+    CHECK(ipr::physically_same(lex1.get_string(u8"w42"), *interned[0][42]));
+    CHECK(ipr::physically_same(lex1.get_string(u8"fresh"), lex2.get_string(u8"fresh")));
+
+    // A thread alternating between pools interns into each of them.
+    ipr::util::shared_string_pool other { };
+    for (int i = 0; i < 100; ++i)
+    {
+        const auto& x = other.intern(numbered(u8"v", i));
+        const auto& y = pool.intern(numbered(u8"v", i));
+        CHECK(not ipr::physically_same(x, y));
+        CHECK(x.characters() == y.characters());
+        CHECK(ipr::physically_same(other.intern(numbered(u8"v", i)), x));
+    }
+}
+
+TEST_CASE("interned strings have dense identification numbers")
+{
+    ipr::util::string_pool pool { };
+    const auto first = pool.id_bound();
+    CHECK(ipr::util::intern_id(pool.intern(u8"")) == 0);
+    const auto known = ipr::util::intern_id(pool.intern(u8"int"));
+    CHECK(known > 0);
+    CHECK(known < first);
+    CHECK(ipr::util::intern_id(pool.intern(u8"bool")) != known);
+
+    std::vector<bool> seen(first + 100);
+    for (int i = 0; i < 100; ++i)
+    {
+        auto& s = pool.intern(numbered(u8"v", i));
+        const auto id = ipr::util::intern_id(s);
+        REQUIRE(id >= first);
+        REQUIRE(id < pool.id_bound());
+        seen[id] = true;
+        CHECK(ipr::util::intern_id(pool.intern(s.characters())) == id);
+    }
+    CHECK(pool.id_bound() == first + 100);
+    CHECK(std::count(seen.begin() + first, seen.end(), true) == 100);
+
+    auto& a = pool.intern(u8"zeta");
+    auto& b = pool.intern(u8"alpha");
+    CHECK(ipr::impl::compare_interned(a, b) < 0);
+    CHECK(ipr::impl::compare_interned(a, a) == 0);
+
+    // Strings not interned by a pool are never taken for interned strings.
+    const ipr::impl::String loose { u8"loose" };
+    const ipr::impl::String other { u8"other" };
+    CHECK(ipr::util::intern_id(loose) == ipr::impl::String::unnumbered);
+    CHECK(ipr::impl::compare_interned(a, loose) < 0);
+    CHECK(ipr::impl::compare_interned(loose, other) < 0);
+
+    // Nor are strings of other implementations of ipr::String.
+    struct Foreign_string : ipr::String {
+        ipr::util::word_view characters() const final { return u8"foreign"; }
+        void accept(ipr::Visitor& v) const final { v.visit(*this); }
+    };
+    const Foreign_string foreign { };
+    CHECK(ipr::util::intern_id(foreign) == ipr::impl::String::unnumbered);
+    CHECK(ipr::impl::compare_interned(a, foreign) < 0);
+    CHECK(ipr::impl::compare_interned(foreign, loose) < 0);
+
+    ipr::impl::Lexicon lexicon { };
+    auto& id = lexicon.get_identifier(u8"counter");
+    CHECK(ipr::util::intern_id(id.string()) < lexicon.string_id_bound());
+    CHECK(ipr::util::intern_id(id.string()) == ipr::util::intern_id(lexicon.get_string(u8"counter")));
+}
+
+TEST_CASE("identifiers requested in bulk are unified")
+{
+    std::vector<std::u8string> texts;
+    for (int i = 0; i < 1000; ++i)
+        texts.push_back(numbered(u8"b", i % 300));
+    texts.push_back(u8"int");
+    texts.push_back(u8"");
+    const std::vector<ipr::util::word_view> words(texts.begin(), texts.end());
+
+    ipr::impl::Lexicon lexicon { };
+    std::vector<const ipr::Identifier*> ids(words.size() + 5);
+    const auto filled = lexicon.get_identifiers(words, ids);
+    REQUIRE(filled.size() == words.size());
+    for (std::size_t i = 0; i < words.size(); ++i)
+    {
+        CHECK(filled[i]->string().characters() == words[i]);
+        CHECK(ipr::physically_same(*filled[i], lexicon.get_identifier(words[i])));
+    }
+    CHECK(ipr::physically_same(*filled[7], *filled[307]));
+
+    ipr::util::string_pool pool { };
+    std::vector<const ipr::String*> strings(words.size());
+    pool.intern(words, strings);
+    for (std::size_t i = 0; i < words.size(); ++i)
+        CHECK(ipr::physically_same(*strings[i], pool.intern(words[i])));
+}
+
+TEST_CASE("string pools layered over images")
+{
+    ipr::util::string_pool seed { };
+    for (int i = 0; i < 1000; ++i)
+        seed.intern(numbered(u8"lib_", i));
+    std::ostringstream os;
+    seed.write_image(os);
+    const auto data = os.str();
+    const std::u8string bytes(data.begin(), data.end());
+
+    const ipr::util::string_image image { bytes };
+    CHECK(image.size() == 1000);
+    ipr::util::string_pool pool { };
+    pool.layer_over(image);
+    CHECK(pool.id_bound() == seed.id_bound());
+    for (int i = 0; i < 1000; i += 37)
+    {
+        auto& s = pool.intern(numbered(u8"lib_", i));
+        CHECK(s.characters() == numbered(u8"lib_", i));
+        CHECK(ipr::util::intern_id(s) == ipr::util::intern_id(seed.intern(numbered(u8"lib_", i))));
+        CHECK(ipr::physically_same(s, pool.intern(numbered(u8"lib_", i))));
+        // The characters are those of the image, not a copy.
+        CHECK(s.characters().data() >= bytes.data());
+        CHECK(s.characters().data() < bytes.data() + bytes.size());
+    }
+    CHECK(ipr::util::intern_id(pool.intern(u8"overflow")) == seed.id_bound());
+    CHECK(ipr::physically_same(pool.intern(u8"int"), seed.intern(u8"int")));
+
+    ipr::impl::Lexicon lexicon { image };
+    CHECK(lexicon.get_identifier(numbered(u8"lib_", 5)).string().characters() == numbered(u8"lib_", 5));
+
+    auto corrupted = bytes;
+    corrupted[0] ^= 0x20;
+    CHECK_THROWS_AS(ipr::util::string_image{ corrupted }, std::runtime_error);
+    CHECK_THROWS_AS(ipr::util::string_image{ bytes.substr(0, bytes.size() - 1) }, std::runtime_error);
+}
+
+TEST_CASE("name nodes are unified")
+{
+    ipr::impl::Lexicon lexicon { };
+    std::vector<const ipr::Identifier*> ids;
+    for (int i = 0; i < 5000; ++i)
+        ids.push_back(&lexicon.get_identifier(numbered(u8"n", i)));
+    for (int i = 0; i < 5000; ++i)
+        CHECK(ipr::physically_same(lexicon.get_identifier(numbered(u8"n", i)), *ids[i]));
+    CHECK(not ipr::physically_same(*ids[0], *ids[1]));
+
+    // Identifiers and operators are unified by the address of their string.
+    CHECK(ipr::physically_same(lexicon.get_identifier(lexicon.get_string(numbered(u8"n", 42))), *ids[42]));
+    CHECK(ipr::physically_same(lexicon.get_operator(u8"+="), lexicon.get_operator(lexicon.get_string(u8"+="))));
+    ipr::util::string_pool other { };
+    auto& foreign = other.intern(u8"n43");
+    CHECK(ipr::physically_same(lexicon.get_identifier(foreign), lexicon.get_identifier(foreign)));
+    CHECK(not ipr::physically_same(lexicon.get_identifier(foreign), *ids[43]));
+
+    CHECK(ipr::physically_same(lexicon.get_suffix(*ids[7]), lexicon.get_suffix(*ids[7])));
+    CHECK(not ipr::physically_same(lexicon.get_suffix(*ids[7]), lexicon.get_suffix(*ids[8])));
+    auto& t = lexicon.int_type();
+    CHECK(ipr::physically_same(lexicon.get_ctor_name(t), lexicon.get_ctor_name(t)));
+    CHECK(ipr::physically_same(lexicon.get_conversion(t), lexicon.get_conversion(t)));
+    CHECK(ipr::physically_same(lexicon.get_dtor_name(t).operand(), t));
+}